@@ -1,152 +1,781 @@
-﻿#include<iostream>
+#include<iostream>
 #include<complex>
 #include<vector>
 #include<cmath>
 #include<fstream>
+#include<functional>
+#include<random>
+#include<sstream>
+#include<cstdio>
+#include<cstring>
+#include<arpa/inet.h>
+#include<netinet/in.h>
+#include<sys/socket.h>
+#include<unistd.h>
+#include<string>
+#include "../Newton/Newton.cpp"
+#include "../Newton/RenderService.h"
+#include "../Newton/ParameterSweep.h"
+#include "../Newton/Symmetry.h"
+#include "../Newton/Certify.h"
+#include "../Newton/Expression.h"
+#include "../Newton/BatchRunner.h"
+#include "../Newton/Remote.h"
 
-using complex = std::complex<double>;
+int failures = 0;
 
-class Newton final {
-public:
-	std::pair<double, double> c1, c4;
-	int height;
-	int width;
-	std::vector<std::pair<complex, char>> roots;
-	int number_of_iterations;
+void check(bool condition, const std::string &message) {
+	if (!condition) {
+		std::cout << "FAILED: " << message << std::endl;
+		failures++;
+	}
+}
 
-	complex calculate_polinomial(complex meaning) {
-		complex res(1, 0);
-		for (auto root_n = 0; root_n != roots.size(); root_n++) {
-			res *= (meaning - roots[root_n].first);
+void method_test() {
+	Newton n(std::make_pair(0.1, 1), std::make_pair(2, -1));
+	n.set_dimensions(100, 100);
+	n.get_root(1, 0, 1);
+	n.get_root(-1, 0, 2);
+	std::vector<char> help;
+	n.method(help);
+	bool flag = false;
+	for (auto cnt = 0; cnt != help.size(); ++cnt) {
+		if (help[cnt] == 1) {
+			continue;
+		}
+		else {
+			flag = true;
+			break;
 		}
-		return res;
 	}
+	check(help.size() == 100 * 100, "method fills width * height cells");
+	check(!flag, "method does not converge to the right root");
+}
 
-	complex calculate_derivative(complex meaning) {
-		complex derivative = complex(0, 0);
-		for (auto i = 0; i < roots.size(); ++i) {
-			complex var = complex(1, 0);
-			for (auto j = 0; j < roots.size(); ++j) {
-				if (i != j) {
-					var *= meaning - roots[j].first;
-				}
+void test_calculate_polinomial() {
+	std::vector<std::pair<complex, char>> roots = { {complex(1, 0), 1}, {complex(-1, 0), 2} };
+	check(std::abs(Newton::calculate_polinomial(roots, complex(2, 0)) - complex(3, 0)) < 1e-12, "calculate_polinomial");
+}
+
+void test_calculate_derivative() {
+	std::vector<std::pair<complex, char>> roots = { {complex(1, 0), 1}, {complex(-1, 0), 2} };
+	check(std::abs(Newton::calculate_derivative(roots, complex(2, 0)) - complex(4, 0)) < 1e-12, "calculate_derivative");
+}
+
+// Differential harness: every optimized path must reproduce Newton::method on
+// random root sets, viewports, resolutions and iteration limits. Pixels next to
+// a basin boundary may legitimately flip, anything else is a bug.
+
+struct Path {
+	std::string name;
+	std::function<void(const RenderDesc &, std::vector<char> &)> render;
+};
+
+std::vector<char> reference(const RenderDesc &desc) {
+	Newton n(desc.c1, desc.c4);
+	n.set_dimensions(desc.width, desc.height);
+	n.set_iterations(desc.number_of_iterations);
+	for (auto root = desc.roots.begin(); root != desc.roots.end(); ++root) {
+		n.get_root(root->first.real(), root->first.imag(), root->second);
+	}
+	std::vector<char> draw;
+	n.method(draw, desc.a);
+	return draw;
+}
+
+RenderDesc random_desc(std::mt19937 &gen) {
+	std::uniform_real_distribution<double> position(-1.5, 1.5);
+	std::uniform_real_distribution<double> size(0.05, 4);
+	std::uniform_int_distribution<int> root_count(1, 6);
+	std::uniform_int_distribution<int> side(8, 96);
+	std::uniform_int_distribution<int> iterations(1, 60);
+	RenderDesc desc;
+	int count = root_count(gen);
+	for (auto i = 0; i < count; ++i) {
+		desc.roots.push_back(std::make_pair(complex(position(gen), position(gen)), char(i)));
+	}
+	double centre_x = position(gen), centre_y = position(gen), w = size(gen), h = size(gen);
+	desc.c1 = std::make_pair(centre_x - w / 2, centre_y + h / 2);
+	desc.c4 = std::make_pair(centre_x + w / 2, centre_y - h / 2);
+	desc.width = side(gen);
+	desc.height = side(gen);
+	desc.number_of_iterations = iterations(gen);
+	desc.a = complex(1, 0);
+	desc.certify_tiles = gen() % 4 != 0;
+	if (gen() % 2) {
+		// Anywhere in the disk |1 - a| < 1 where relaxed Newton converges, including
+		// slow, linearly converging values of a near 0 and 2.
+		std::uniform_real_distribution<double> unit(0, 1);
+		desc.a += std::polar(0.95 * std::sqrt(unit(gen)), 2 * 3.14159265358979323846 * unit(gen));
+	}
+	return desc;
+}
+
+// Whether the reference iteration of a pixel ends up at a root. Optimized paths
+// may report NO_ROOT for exactly those pixels where it does not.
+bool reference_converged(const RenderDesc &desc, int x, int y) {
+	double fraction_x = (desc.c4.first - desc.c1.first) / desc.width;
+	double fraction_y = (desc.c1.second - desc.c4.second) / desc.height;
+	complex z = complex(desc.c1.first + fraction_x * (0.5 + x), desc.c4.second + fraction_y * (0.5 + y));
+	for (auto idx = 1; idx <= desc.number_of_iterations; ++idx) {
+		z = z - desc.a * (Newton::calculate_polinomial(desc.roots, z) / Newton::calculate_derivative(desc.roots, z));
+	}
+	return std::abs(z - Newton::find_closest_root(desc.roots, z).first) < 1e-6 * Newton::root_scale(desc.roots);
+}
+
+// Root sets with a symmetry: conjugate pairs, or rotated and shifted roots of
+// unity, seen through a viewport around the centre of symmetry.
+RenderDesc random_symmetric_desc(std::mt19937 &gen) {
+	RenderDesc desc = random_desc(gen);
+	std::uniform_real_distribution<double> position(-1.5, 1.5);
+	std::uniform_real_distribution<double> unit(0, 1);
+	std::uniform_int_distribution<int> count(2, 6);
+	int n = count(gen);
+	complex centre(0, 0);
+	desc.roots.clear();
+	switch (gen() % 3) {
+	case 0:
+		for (auto i = 0; desc.roots.size() < n; ++i) {
+			complex root(position(gen), i % 3 == 2 ? 0 : position(gen));
+			desc.roots.push_back(std::make_pair(root, char(desc.roots.size())));
+			if (root.imag() != 0 && desc.roots.size() < n) {
+				desc.roots.push_back(std::make_pair(std::conj(root), char(desc.roots.size())));
 			}
-			derivative += var;
-		}
-		return derivative;
-	}
-public:
-	Newton(std::pair<double, double> c1, std::pair<double, double> c4) :
-		c1(c1), c4(c4) {
-		height = 100;
-		width = 100;
-		number_of_iterations = 100;
-		get_config();
-	}
-
-	~Newton() { }
-	Newton(const Newton&) = delete;
-	Newton& operator=(const Newton&) = delete;
-	Newton(const Newton&&) = delete;
-	Newton& operator=(const Newton&&) = delete;
-
-	void get_root(double Re, double Im, char color) {
-		roots.push_back(std::make_pair(complex(Re, Im), color));
-	}
-	void zoom(std::pair<double, double> cor1, std::pair<double, double> cor4) {
-		c1 = cor1;
-		c4 = cor4;
-	}
-	void method(std::vector<char>& draw, complex a = complex(1, 0)) {
-		double fraction_x = (c4.first - c1.first) / width;
-		double fraction_y = (c1.second - c4.second) / height;
-		for (auto x = 0; x < width; x++) {
-			for (auto y = 0; y < height; y++) {
-				complex z = complex(c1.first + fraction_x * (0.5 + x), c4.second + fraction_y * (0.5 + y));
-				for (auto idx = 1; idx <= number_of_iterations; ++idx) {
-					z = z - a * (calculate_polinomial(z) / calculate_derivative(z));
-				}
-				draw.push_back(find_closest_root(z).second);
+		}
+		centre = complex(position(gen) / 2, 0);
+		break;
+	case 1:
+		centre = complex(position(gen), position(gen));
+		{
+			complex start = std::polar(0.3 + unit(gen), 2 * 3.14159265358979323846 * unit(gen));
+			for (auto i = 0; i < n; ++i) {
+				desc.roots.push_back(std::make_pair(centre + start * std::polar(1.0, 2 * 3.14159265358979323846 * i / n), char(i)));
 			}
 		}
+		break;
+	default:
+		centre = complex(position(gen), 0);
+		for (auto i = 0; i < n; ++i) {
+			desc.roots.push_back(std::make_pair(centre + std::polar(1.0, 2 * 3.14159265358979323846 * i / n), char(i)));
+		}
+		desc.roots.push_back(std::make_pair(centre, char(n)));
+	}
+	double w = desc.c4.first - desc.c1.first, h = desc.c1.second - desc.c4.second;
+	double offset_x = (unit(gen) - 0.5) * w / 2, offset_y = (unit(gen) - 0.5) * h / 2;
+	if (gen() % 2) {
+		offset_x = offset_y = 0;
+		h = w * desc.height / desc.width;
+	}
+	desc.c1 = std::make_pair(centre.real() + offset_x - w / 2, centre.imag() + offset_y + h / 2);
+	desc.c4 = std::make_pair(centre.real() + offset_x + w / 2, centre.imag() + offset_y - h / 2);
+	if (gen() % 2) {
+		desc.a = complex(0.6 + 0.8 * unit(gen), 0);
+	}
+	return desc;
+}
+
+// Root sets with repeated roots and tight clusters, as created by dropping two
+// roots on the same spot in the App.
+RenderDesc random_clustered_desc(std::mt19937 &gen) {
+	RenderDesc desc = random_desc(gen);
+	// Offsets from 1e-9 to 1e-5, evenly spread over the orders of magnitude.
+	std::uniform_real_distribution<double> exponent(-9, -5);
+	std::uniform_real_distribution<double> angle(0, 2 * 3.14159265358979323846);
+	int copies = 1 + gen() % 2;
+	for (auto i = 0; i < copies; ++i) {
+		complex root = desc.roots[gen() % desc.roots.size()].first;
+		if (gen() % 2) {
+			root += std::polar(std::pow(10.0, exponent(gen)), angle(gen));
+		}
+		desc.roots.insert(desc.roots.begin() + gen() % (desc.roots.size() + 1), std::make_pair(root, char(desc.roots.size())));
 	}
+	return desc;
+}
 
-	std::pair<complex, char> find_closest_root(complex meaning) {
-		double min = -1;
-		complex this_root = 0;
-		char color = 0;
-		for (auto iter = 0; iter != roots.size(); iter++) {
-			if (min > abs(meaning - roots[iter].first) || min < 0) {
-				min = abs(meaning - roots[iter].first);
-				this_root = roots[iter].first;
-				color = roots[iter].second;
+bool is_boundary(const std::vector<char> &draw, const RenderDesc &desc, int x, int y) {
+	for (auto dx = -1; dx <= 1; ++dx) {
+		for (auto dy = -1; dy <= 1; ++dy) {
+			int nx = x + dx, ny = y + dy;
+			if (nx < 0 || ny < 0 || nx >= desc.width || ny >= desc.height) {
+				continue;
+			}
+			if (draw[nx * desc.height + ny] != draw[x * desc.height + y]) {
+				return true;
 			}
 		}
-		return std::make_pair(this_root, color);
 	}
+	return false;
+}
 
-	void move_root(char color, std::pair<double, double> new_r) {
-		complex new_root = complex(new_r.first, new_r.second);
-		for (auto idx = 0; idx != roots.size(); idx++) {
-			if (roots[idx].second == color) {
-				roots[idx].first = new_root;
-				break;
+void write_diff(const std::string &file, const RenderDesc &desc, const std::vector<char> &expected,
+	const std::vector<char> &actual) {
+	static const unsigned char palette[8][3] = { {44, 93, 55}, {227, 197, 21}, {238, 81, 177}, {165, 156, 211},
+		{75, 45, 159}, {192, 168, 183}, {90, 160, 220}, {240, 140, 60} };
+	std::ofstream out(file, std::ios::binary);
+	out << "P6\n" << desc.width * 3 << " " << desc.height << "\n255\n";
+	for (auto row = 0; row < desc.height; ++row) {
+		int y = desc.height - 1 - row;
+		for (auto panel = 0; panel < 3; ++panel) {
+			for (auto x = 0; x < desc.width; ++x) {
+				int cell = x * desc.height + y;
+				unsigned char rgb[3] = { 0, 0, 0 };
+				const std::vector<char> &draw = panel == 1 ? actual : expected;
+				if (panel == 2) {
+					if (expected[cell] != actual[cell]) {
+						rgb[0] = 255;
+						rgb[1] = is_boundary(expected, desc, x, y) ? 255 : 0;
+					}
+					else {
+						rgb[0] = rgb[1] = rgb[2] = 96;
+					}
+				}
+				else if (draw[cell] >= 0 && draw[cell] < 8) {
+					for (auto c = 0; c < 3; ++c) {
+						rgb[c] = palette[int(draw[cell])][c];
+					}
+				}
+				out.write(reinterpret_cast<const char *>(rgb), 3);
 			}
 		}
 	}
-	void get_config() {
-		std::ifstream fin("number of iterations.txt");
-		if (fin.is_open()) {
-			fin >> number_of_iterations;
+}
+
+bool compare(const std::string &name, int test_case, const RenderDesc &desc, const std::vector<char> &expected,
+	const std::vector<char> &actual) {
+	if (actual.size() != expected.size()) {
+		check(false, name + " case " + std::to_string(test_case) + ": wrong frame size");
+		return false;
+	}
+	int interior = 0, boundary = 0;
+	for (auto x = 0; x < desc.width; ++x) {
+		for (auto y = 0; y < desc.height; ++y) {
+			if (expected[x * desc.height + y] == actual[x * desc.height + y]) {
+				continue;
+			}
+			if (actual[x * desc.height + y] == Newton::NO_ROOT && !reference_converged(desc, x, y)) {
+				continue;
+			}
+			if (is_boundary(expected, desc, x, y)) {
+				boundary++;
+			}
+			else {
+				interior++;
+			}
 		}
-		fin.close();
 	}
-	std::pair<int, int> get_dimensions() {
-		return { width, height };
+	bool ok = interior == 0 && boundary <= std::max(2, desc.width * desc.height / 50);
+	if (!ok) {
+		std::string file = "diff_" + name + "_" + std::to_string(test_case) + ".ppm";
+		write_diff(file, desc, expected, actual);
+		check(false, name + " case " + std::to_string(test_case) + ": " + std::to_string(interior) +
+			" interior and " + std::to_string(boundary) + " boundary mismatches, see " + file);
 	}
+	return ok;
+}
 
-};
+void differential_test(const std::vector<Path> &paths, int cases, unsigned seed,
+	std::function<RenderDesc(std::mt19937 &)> make_desc) {
+	std::mt19937 gen(seed);
+	for (auto test_case = 0; test_case < cases; ++test_case) {
+		RenderDesc desc = make_desc(gen);
+		std::vector<char> expected = reference(desc);
+		for (auto path = paths.begin(); path != paths.end(); ++path) {
+			std::vector<char> actual;
+			path->render(desc, actual);
+			compare(path->name, test_case, desc, expected, actual);
+		}
+	}
+}
+
+void sweep_test(int cases) {
+	std::mt19937 gen(2028);
+	std::uniform_real_distribution<double> relaxation(-0.5, 0.5);
+	for (auto test_case = 0; test_case < cases; ++test_case) {
+		RenderDesc desc = random_desc(gen);
+		std::vector<complex> a_values;
+		for (auto k = 0; k < 11; ++k) {
+			a_values.push_back(complex(1 + relaxation(gen), relaxation(gen)));
+		}
+		std::vector<std::vector<char>> draws;
+		method_sweep(desc, a_values, draws);
+		check(draws.size() == a_values.size(), "method_sweep returns one frame per value of a");
+		for (auto k = 0; k < a_values.size(); ++k) {
+			desc.a = a_values[k];
+			compare("method_sweep", test_case * 100 + k, desc, reference(desc), draws[k]);
+		}
+	}
+}
 
+void parameter_plane_test() {
+	RenderDesc desc;
+	desc.roots = { {complex(1, 0), 0}, {complex(-0.5, 0.8), 1}, {complex(-0.5, -0.8), 2} };
+	desc.c1 = std::make_pair(0.0, 1.0);
+	desc.c4 = std::make_pair(2.0, -1.0);
+	desc.width = 24;
+	desc.height = 24;
+	desc.number_of_iterations = 50;
+	complex seed(0.3, 0.2);
+	std::vector<char> plane;
+	parameter_plane(desc, seed, plane);
+	std::vector<complex> a_values = parameter_grid(desc.c1, desc.c4, desc.width, desc.height);
+	int converged = 0;
+	for (auto cell = 0; cell < plane.size(); ++cell) {
+		RenderDesc pixel = desc;
+		pixel.c1 = std::make_pair(seed.real() - 0.5, seed.imag() + 0.5);
+		pixel.c4 = std::make_pair(seed.real() + 0.5, seed.imag() - 0.5);
+		pixel.width = pixel.height = 1;
+		pixel.a = a_values[cell];
+		if (plane[cell] != Newton::NO_ROOT) {
+			converged++;
+			check(plane[cell] == reference(pixel)[0], "parameter_plane colour matches the root reached from the seed");
+		}
+	}
+	check(converged > 0, "parameter_plane finds convergent parameters");
+	check(plane[a_values.size() - 1] == Newton::NO_ROOT, "a near 2 + i does not converge");
+}
 
+// z^3 - 2z + 2 has the attracting cycle 0 -> 1 -> 0, and z^2 - 1 has a
+// critical point at 0: both must come out as NO_ROOT instead of a basin colour.
+void non_convergent_test() {
+	RenderDesc desc;
+	desc.roots = { {complex(-1.7692923542386314, 0), 0}, {complex(0.8846461771193157, 0.5897428050222054), 1},
+		{complex(0.8846461771193157, -0.5897428050222054), 2} };
+	desc.number_of_iterations = 1000000;
+	desc.a = complex(1, 0);
+	double scale = Newton::root_scale(desc.roots);
+	std::vector<RootCluster> clusters;
+	check(Newton::calculate_pixel(desc, complex(0, 0), scale, clusters) == Newton::NO_ROOT, "attracting cycle is detected");
+	check(Newton::calculate_pixel(desc, complex(0.01, 0.01), scale, clusters) == Newton::NO_ROOT, "basin of a cycle is detected");
+	check(Newton::calculate_pixel(desc, complex(-2, 0), scale, clusters) == 0, "real root still converges");
+	desc.roots = { {complex(1, 0), 0}, {complex(-1, 0), 1} };
+	check(Newton::calculate_pixel(desc, complex(0, 0), 1, clusters) == Newton::NO_ROOT, "critical point is detected");
+	desc.roots = { {complex(-1.67461, -0.0856791), 0}, {complex(-1.39791, -0.312632), 1}, {complex(0.6576, 0.227841), 2} };
+	desc.a = complex(0.447832, 0.0432102);
+	desc.number_of_iterations = 60;
+	check(Newton::calculate_pixel(desc, complex(-1.8294, -0.20853), Newton::root_scale(desc.roots), clusters) == 0,
+		"linear convergence with relaxed a is not taken for a cycle");
 
-void method_test() {
-	Newton n(std::make_pair(0.1, 1), std::make_pair(2, -1));
-	n.get_root(1, 0, '1');
-	n.get_root(-1, 0, '-1');
-	std::vector<char> help;
-	n.method(help);
-	bool flag = false;
-	for (auto cnt = 0; cnt != help.size(); ++cnt) {
-		if (help[cnt] == '1') {
-			continue;
+	// z^3 - 2z + 2.01 has an attracting cycle near 0 that the orbits approach
+	// only slowly; after a short budget they are neither in a cycle nor at a root.
+	desc.roots = { {complex(-1.7706440046836216, 0), 0}, {complex(0.8853220023418108, 0.5927774822743689), 1},
+		{complex(0.8853220023418108, -0.5927774822743689), 2} };
+	desc.c1 = std::make_pair(-0.1, 0.1);
+	desc.c4 = std::make_pair(0.1, -0.1);
+	desc.width = desc.height = 40;
+	desc.number_of_iterations = 20;
+	desc.a = complex(1, 0);
+	scale = Newton::root_scale(desc.roots);
+	int wrong = 0;
+	for (auto x = 0; x < desc.width; ++x) {
+		for (auto y = 0; y < desc.height; ++y) {
+			complex z(-0.1 + 0.005 * (0.5 + x), -0.1 + 0.005 * (0.5 + y));
+			bool no_root = Newton::calculate_pixel(desc, z, scale, clusters) == Newton::NO_ROOT;
+			wrong += no_root == reference_converged(desc, x, y);
 		}
-		else {
-			flag = true;
-			break;
+	}
+	check(wrong == 0, "exhausted iterations away from every root give NO_ROOT");
+}
+
+void symmetry_test() {
+	RenderDesc desc;
+	desc.c1 = std::make_pair(-1.0, 1.0);
+	desc.c4 = std::make_pair(1.0, -1.0);
+	desc.width = desc.height = 40;
+	desc.number_of_iterations = 50;
+	desc.a = complex(1, 0);
+	for (auto i = 0; i < 5; ++i) {
+		desc.roots.push_back(std::make_pair(std::polar(1.0, 2 * 3.14159265358979323846 * i / 5), char(i)));
+	}
+	check(Symmetry(desc).group_size() == 10, "fifth roots of unity have dihedral symmetry of order 10");
+	desc.a = complex(1, 0.1);
+	check(Symmetry(desc).group_size() == 5, "complex a keeps only the rotations");
+	desc.roots = { {complex(0.5, 0.7), 0}, {complex(0.5, -0.7), 1}, {complex(-1, 0), 2} };
+	desc.a = complex(1, 0);
+	check(Symmetry(desc).group_size() == 2, "conjugate pair gives a mirror symmetry");
+	desc.roots.push_back(std::make_pair(complex(0.3, 0.2), char(3)));
+	check(Symmetry(desc).group_size() == 1, "generic roots have no symmetry");
+
+	desc.roots = { {complex(1, 0), 0}, {complex(0, 1), 1}, {complex(-1, 0), 2}, {complex(0, -1), 3} };
+	desc.certify_tiles = false;
+	std::vector<char> draw(desc.width * desc.height);
+	Symmetry(desc).render_columns(desc, draw.data(), 0, desc.width);
+	// Pixels on the diagonals are fixed by a reflection, all others come in orbits of eight.
+	check(std::count(draw.begin(), draw.end(), char(Newton::PENDING)) == draw.size() - 190 - 20,
+		"centred square view of z^4 - 1 iterates one pixel per orbit");
+}
+
+void certify_test() {
+	RenderDesc desc;
+	desc.roots = { {complex(0.3, 0.2), 0}, {complex(-0.5, 0.4), 1}, {complex(0.1, -0.6), 2}, {complex(0.7, -0.1), 3} };
+	desc.c1 = std::make_pair(-1.0, 0.8);
+	desc.c4 = std::make_pair(1.0, -0.8);
+	desc.width = 200;
+	desc.height = 160;
+	desc.number_of_iterations = 50;
+	desc.a = complex(1, 0);
+	TileCertifier certifier(desc);
+	check(certifier.certify(complex(0.31, 0.2), 0.01) == 0, "disk around a root is certified");
+	check(certifier.certify(complex(1.5, 1.5), 0.05) != Newton::PENDING, "disk far out in a basin is certified");
+	check(certifier.certify(complex(-0.1, 0.3), 0.05) == Newton::PENDING, "disk across a basin boundary is not certified");
+	desc.number_of_iterations = 0;
+	check(TileCertifier(desc).certify(complex(1.5, 1.5), 0.05) == Newton::PENDING, "certificates respect the iteration limit");
+	desc.number_of_iterations = 50;
+
+	std::vector<char> draw(desc.width * desc.height);
+	certifier.render_columns(desc, draw.data(), 0, desc.width);
+	std::vector<char> expected = reference(desc);
+	int certified = 0, wrong = 0;
+	for (auto cell = 0; cell < draw.size(); ++cell) {
+		if (draw[cell] != Newton::PENDING) {
+			certified++;
+			wrong += draw[cell] != expected[cell];
 		}
 	}
-	if (flag)
-		std::cout << "Does not converge to the right root!" << std::endl;
-	else
-		std::cout << "Method do work" << std::endl;
+	check(wrong == 0, "certified tiles agree with Newton::method");
+	check(certified > draw.size() / 2, "most of a generic view is certified");
 }
 
-void test_calculate_polinomial() {
-	Newton n(std::make_pair(0.1, 1), std::make_pair(2, -1));
-	n.get_root(1, 0, '1');
-	n.get_root(-1, 0, '-1');
-	std::cout << n.calculate_polinomial(complex(2, 0)) << std::endl;
+void multiplicity_test() {
+	RenderDesc desc;
+	desc.roots = { {complex(1, 0), 0}, {complex(-1, 0), 1}, {complex(1, 0), 2}, {complex(1, 1e-12), 3} };
+	desc.c1 = std::make_pair(0.2, 1.0);
+	desc.c4 = std::make_pair(3.0, -1.0);
+	desc.width = 40;
+	desc.height = 30;
+	desc.number_of_iterations = 12;
+	desc.a = complex(1, 0);
+	std::vector<RootCluster> clusters = Newton::find_clusters(desc.roots);
+	check(clusters.size() == 1 && clusters[0].multiplicity == 3, "triple root is found as one cluster");
+	check(Newton::find_closest_root(desc.roots, complex(1, 1e-12)).second == 0, "coincident roots share one colour");
+	desc.certify_tiles = false;
+	std::vector<char> draw(desc.width * desc.height);
+	Newton::render_columns(desc, draw.data(), 0, desc.width);
+	check(std::count(draw.begin(), draw.end(), char(0)) == draw.size(), "basin of a triple root converges within 12 iterations");
+	std::vector<std::pair<complex, char>> close = { {complex(1, 0), 0}, {complex(1, 1e-6), 1}, {complex(-1, 0), 2} };
+	check(Newton::find_closest_root(close, complex(1, 2e-6)).second == 1, "close roots keep their own colours");
+	check(Newton::find_clusters(close).empty(), "close roots of different colours are not stepped to as one");
+
+	desc.roots = { {complex(0.3, 0.2), 0}, {complex(-0.8, 0.5), 1}, {complex(0.1, -0.9), 2}, {complex(0.3 + 1e-8, 0.2), 3} };
+	desc.c1 = std::make_pair(-2.0, 2.0);
+	desc.c4 = std::make_pair(2.0, -2.0);
+	desc.width = 200;
+	desc.height = 200;
+	desc.number_of_iterations = 60;
+	draw.assign(desc.width * desc.height, 0);
+	Newton::render_columns(desc, draw.data(), 0, desc.width);
+	check(draw == reference(desc), "nearly coincident roots keep their basin instead of cycling at the critical point");
+
+	// Roots within the cluster tolerance but far apart in the view are
+	// distinct attractors with a basin each.
+	desc.roots = { {complex(0, 0), 0}, {complex(5e-4, 0), 1}, {complex(1, 0.3), 2} };
+	desc.c1 = std::make_pair(-1e-3, 1e-3);
+	desc.c4 = std::make_pair(1.5e-3, -1e-3);
+	desc.width = 60;
+	desc.height = 40;
+	desc.number_of_iterations = 50;
+	draw.assign(desc.width * desc.height, 0);
+	Newton::render_columns(desc, draw.data(), 0, desc.width);
+	check(std::count(draw.begin(), draw.end(), char(0)) == draw.size() / 2 &&
+		std::count(draw.begin(), draw.end(), char(1)) == draw.size() / 2, "close roots split the view between their basins");
+	compare("close roots", 0, desc, reference(desc), draw);
+	check(Newton::find_closest_root({ {complex(1000, 0), 0}, {complex(1000.5, 0), 1}, {complex(-1000, 0), 2} }, complex(1000.5, 0)).second == 1,
+		"roots half a unit apart at scale 1000 are not merged");
 }
 
-void test_calculate_derivative() {
-	Newton n(std::make_pair(0.1, 1), std::make_pair(2, -1));
-	n.get_root(1, 0, '1');
-	n.get_root(-1, 0, '-1');
-	std::cout << n.calculate_derivative(complex(2, 0)) << std::endl;
+void expression_test() {
+	check(!Expression("z^"), "incomplete expression is rejected");
+	check(!Expression("foo(z)"), "unknown function is rejected");
+	check(!Expression("(z + 1"), "unbalanced parenthesis is rejected");
+
+	Expression e("sin(z) * (z^3 - 1) + exp(z) / (2z + i) - sqrt(z + 3)^pi");
+	check(bool(e), "expression with functions and implicit multiplication parses");
+	std::vector<complex> points = { complex(0.3, 0.2), complex(-1.1, 0.7), complex(2, -0.4) };
+	std::vector<complex> f(points.size()), df(points.size());
+	e.evaluate(points.data(), points.size(), f.data(), df.data());
+	for (std::size_t k = 0; k < points.size(); ++k) {
+		complex exact = std::sin(points[k]) * (std::pow(points[k], 3) - 1.0) + std::exp(points[k]) / (2.0 * points[k] + complex(0, 1)) -
+			std::pow(std::sqrt(points[k] + 3.0), complex(3.14159265358979323846, 0));
+		complex h(1e-6, 0), plus[1], minus[1], unused[1];
+		complex shifted[2] = { points[k] + h, points[k] - h };
+		e.evaluate(shifted, 1, plus, unused);
+		e.evaluate(shifted + 1, 1, minus, unused);
+		check(std::abs(f[k] - exact) < 1e-9 * (1 + std::abs(exact)), "bytecode value matches std::complex");
+		check(std::abs(df[k] - (plus[0] - minus[0]) / (2.0 * h)) < 1e-5 * (1 + std::abs(df[k])), "derivative matches finite difference");
+	}
+
+	// Integer powers keep their exponent out of the register file.
+	Expression power("z^60 - z^-3");
+	complex z(1.01, 0.02), value, slope;
+	power.evaluate(&z, 1, &value, &slope);
+	complex exact = std::pow(z, 60) - std::pow(z, -3);
+	check(std::abs(value - exact) < 1e-9 * std::abs(exact), "large integer powers are evaluated exactly");
+
+	RenderDesc desc;
+	desc.roots = { {complex(1, 0), 0}, {complex(-1, 0), 1}, {complex(0, 1), 2}, {complex(-0.5, 0.5), 3} };
+	desc.c1 = std::make_pair(-2.0, 1.7);
+	desc.c4 = std::make_pair(1.8, -1.9);
+	desc.width = 70;
+	desc.height = 90;
+	desc.number_of_iterations = 40;
+	desc.a = complex(1, 0);
+	Expression polynomial("(z - 1)(z + 1)(z - i)(z + 0.5 - 0.5i)");
+	std::vector<complex> attractors = polynomial.find_attractors(desc);
+	check(attractors.size() == desc.roots.size(), "every root of the polynomial is found as an attractor");
+	std::vector<char> draw(desc.width * desc.height);
+	polynomial.render_columns(desc, attractors, draw.data(), 0, desc.width);
+	for (auto pixel = draw.begin(); pixel != draw.end(); ++pixel) {
+		if (*pixel != Newton::NO_ROOT)
+			*pixel = Newton::find_closest_root(desc.roots, attractors[*pixel]).second;
+	}
+	desc.certify_tiles = false;
+	compare("Expression", 0, desc, reference(desc), draw);
+
+	desc.c1 = std::make_pair(-4.0, 1.0);
+	desc.c4 = std::make_pair(4.0, -1.0);
+	std::vector<complex> zeros = Expression("sin(z)").find_attractors(desc);
+	int found = 0;
+	for (auto zero = zeros.begin(); zero != zeros.end(); ++zero) {
+		double k = zero->real() / 3.14159265358979323846;
+		found += std::abs(k - std::round(k)) < 1e-9 && std::abs(zero->imag()) < 1e-9;
+	}
+	check(found == zeros.size() && found >= 3, "attractors of sin(z) are multiples of pi");
+}
+
+void batch_test() {
+	std::vector<BatchJob> jobs;
+	std::string error;
+	std::istringstream bad("a.bmp 10 10 20 -1 1 1 -1 0 0 1\n");
+	check(!BatchRunner::read_jobs(bad, jobs, error) && error.find("line 1") == 0, "odd root coordinates are rejected");
+	std::istringstream huge("a.bmp 1000000 1000000 20 -1 1 1 -1 0 0\n");
+	check(!BatchRunner::read_jobs(huge, jobs, error) && error.find("pixels") != std::string::npos, "oversized frames are rejected");
+	std::istringstream endless("a.bmp 10 10 2000000000 -1 1 1 -1 0 0\n");
+	check(!BatchRunner::read_jobs(endless, jobs, error) && error.find("iterations") != std::string::npos,
+		"unbounded iteration counts are rejected");
+	jobs.clear();
+
+	std::mt19937 gen(2035);
+	std::ostringstream list;
+	list << "# output width height iterations left top right bottom roots\n\n";
+	for (auto i = 0; i < 25; ++i) {
+		RenderDesc desc = random_desc(gen);
+		list << "frame" << i << ".bmp " << desc.width << ' ' << desc.height << ' ' << desc.number_of_iterations << ' '
+			<< desc.c1.first << ' ' << desc.c1.second << ' ' << desc.c4.first << ' ' << desc.c4.second;
+		for (auto root = desc.roots.begin(); root != desc.roots.end(); ++root)
+			list << ' ' << root->first.real() << ' ' << root->first.imag();
+		list << '\n';
+	}
+	std::istringstream in(list.str());
+	check(BatchRunner::read_jobs(in, jobs, error) && jobs.size() == 25, "job list is read");
+
+	// Few threads and many jobs of different sizes, so pooled buffers are reused with stale contents.
+	BatchRunner runner({ {{255, 0, 0}}, {{0, 255, 0}} }, {{0, 0, 0}}, 2);
+	std::vector<std::vector<char> > frames(jobs.size());
+	BatchReport report = runner.run(jobs, [&](const BatchJob &job, const std::vector<char> &draw) {
+		frames[&job - jobs.data()] = draw;
+		return true;
+	});
+	check(report.images == 25 && report.failed == 0, "every job is handed to the sink");
+	for (auto i = 0; i < jobs.size(); ++i) {
+		jobs[i].desc.certify_tiles = false;
+		compare("BatchRunner", i, jobs[i].desc, reference(jobs[i].desc), frames[i]);
+	}
+
+	std::istringstream options("plane.bmp 50 40 30 0.2 1 2 -1 plane=0.3,0.2 1 0 -0.5 0.8 -0.5 -0.8\n"
+		"relaxed.bmp 50 40 30 -1 1 1 -1 a=0.7,0.1 1 0 -0.5 0.8 -0.5 -0.8\n");
+	std::vector<BatchJob> option_jobs;
+	check(BatchRunner::read_jobs(options, option_jobs, error) && option_jobs.size() == 2 && option_jobs[0].plane &&
+		option_jobs[1].desc.a == complex(0.7, 0.1), "job options are read");
+	frames.assign(2, std::vector<char>());
+	runner.run(option_jobs, [&](const BatchJob &job, const std::vector<char> &draw) {
+		frames[&job - option_jobs.data()] = draw;
+		return true;
+	});
+	std::istringstream expression_jobs("sin.bmp 60 30 40 -4 1 4 -1 f=sin(z)\n"
+		"bad.bmp 60 30 40 -4 1 4 -1 f=sin(z\n");
+	std::vector<BatchJob> sin_jobs;
+	check(!BatchRunner::read_jobs(expression_jobs, sin_jobs, error) && error.find("missing ')'") != std::string::npos,
+		"expression errors are reported");
+	check(sin_jobs.size() == 1 && sin_jobs[0].expression, "f= jobs need no roots");
+	std::vector<char> sin_frame;
+	runner.run(sin_jobs, [&](const BatchJob &job, const std::vector<char> &draw) {
+		sin_frame = draw;
+		return true;
+	});
+	std::vector<complex> attractors = sin_jobs[0].expression->find_attractors(sin_jobs[0].desc);
+	std::vector<char> expected(sin_jobs[0].desc.width * sin_jobs[0].desc.height);
+	sin_jobs[0].expression->render_columns(sin_jobs[0].desc, attractors, expected.data(), 0, sin_jobs[0].desc.width);
+	check(sin_frame == expected, "f= jobs render the expression");
+
+	std::ostringstream sweep_line;
+	sweep_line << "sweep.bmp 40 30 25 -1.5 1 1.5 -1 a=";
+	for (auto k = 0; k < 10; ++k)
+		sweep_line << (k ? ";" : "") << 0.5 + 0.1 * k << ',' << 0.05 * (k % 3);
+	sweep_line << " 1 0 -0.5 0.8 -0.5 -0.8 0.3 0.1\n";
+	std::istringstream sweep_in(sweep_line.str());
+	std::vector<BatchJob> sweep_jobs;
+	check(BatchRunner::read_jobs(sweep_in, sweep_jobs, error) && sweep_jobs.size() == 10 && sweep_jobs[0].sweep == 10 &&
+		sweep_jobs[3].output == "sweep_3.bmp", "a= lists expand into one job per value");
+	std::vector<std::vector<char> > sweep_frames(sweep_jobs.size());
+	report = runner.run(sweep_jobs, [&](const BatchJob &job, const std::vector<char> &draw) {
+		sweep_frames[&job - sweep_jobs.data()] = draw;
+		return true;
+	});
+	check(report.images == 10, "every value of a of a sweep is written");
+	for (auto k = 0; k < sweep_jobs.size(); ++k)
+		check(sweep_frames[k] == reference(sweep_jobs[k].desc), "sweep frames match Newton::method");
+
+	std::vector<char> plane;
+	parameter_plane(option_jobs[0].desc, option_jobs[0].seed, plane);
+	check(frames[0] == plane, "plane= jobs render the parameter plane");
+	option_jobs[1].desc.certify_tiles = false;
+	compare("BatchRunner a=", 0, option_jobs[1].desc, reference(option_jobs[1].desc), frames[1]);
+
+	jobs.resize(1);
+	jobs[0].output = "batch_test.bmp";
+	report = runner.run(jobs);
+	std::ifstream bmp("batch_test.bmp", std::ios::binary | std::ios::ate);
+	int row = (3 * jobs[0].desc.width + 3) / 4 * 4;
+	check(report.images == 1 && bmp.tellg() == 54 + row * jobs[0].desc.height, "BMP file has the expected size");
+	bmp.close();
+	std::remove("batch_test.bmp");
+}
+
+void remote_test() {
+	std::mt19937 gen(2036);
+	std::vector<unsigned char> bytes, compressed, expanded;
+	for (auto i = 0; i < 2000; ++i)
+		bytes.push_back(gen() % 3 == 0 ? gen() % 256 : 7);
+	bytes.insert(bytes.end(), 1000, 0);
+	packbits_compress(bytes, compressed);
+	check(packbits_expand(compressed.data(), compressed.size(), bytes.size(), expanded) && expanded == bytes, "PackBits round trip");
+	check(!packbits_expand(compressed.data(), compressed.size() - 1, bytes.size(), expanded), "truncated PackBits data is rejected");
+
+	RenderServer server(0, 2);
+	check(bool(server), "render server listens on a free port");
+	std::thread serving(&RenderServer::serve, &server);
+	{
+		RemoteClient client("127.0.0.1", server.get_port());
+		check(bool(client), "client connects to the render server");
+		RenderDesc desc;
+		desc.roots = { {complex(1, 0), 0}, {complex(-0.5, 0.8), 1}, {complex(-0.5, -0.9), 2}, {complex(0.2, 0.1), 3} };
+		desc.c1 = std::make_pair(-1.6, 1.2);
+		desc.c4 = std::make_pair(1.6, -1.2);
+		desc.width = 160;
+		desc.height = 120;
+		desc.number_of_iterations = 25;
+		desc.a = complex(1, 0);
+		desc.certify_tiles = false;
+		compare("Remote key frame", 0, desc, reference(desc), *client.submit(desc, 0).get());
+		long long key = client.get_bytes_received();
+		check(key < desc.width * desc.height / 2, "key frame is smaller than one nibble per pixel");
+
+		desc.roots[3].first = complex(0.22, 0.1);
+		compare("Remote delta frame", 0, desc, reference(desc), *client.submit(desc, 0).get());
+		long long delta = client.get_bytes_received() - key;
+		check(delta < key, "moving one root sends a smaller delta frame");
+		client.submit(desc, 0).get();
+		check(client.get_bytes_received() - key - delta < desc.width * desc.height / 2 / 40, "an unchanged frame costs almost nothing");
+
+		RenderDesc strip = desc.region(10, 20, 30, 40);
+		compare("Remote region", 0, strip, reference(strip), *client.submit(strip).get());
+		for (auto i = 4; i < 20; ++i)
+			desc.roots.push_back(std::make_pair(complex(std::cos(i * 0.9), std::sin(i * 1.3)), char(i)));
+		desc.number_of_iterations = 60;
+		compare("Remote 8-bit plane", 0, desc, reference(desc), *client.submit(desc, 0).get());
+	}
+
+	// A VIEW command asking for a huge frame gets the connection closed.
+	int raw = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(server.get_port());
+	std::vector<unsigned char> view = { 1, 40, 0, 0, 0 };
+	view.resize(view.size() + 32);
+	for (auto value : { 0x7fffffff, 0x7fffffff })
+		for (auto i = 0; i < 4; ++i)
+			view.push_back((value >> (8 * i)) & 0xff);
+	timeval timeout = { 5, 0 };
+	setsockopt(raw, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	char reply;
+	check(connect(raw, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0 &&
+		send(raw, view.data(), view.size(), 0) == view.size() && recv(raw, &reply, 1, 0) == 0,
+		"server drops a client that asks for an oversized frame");
+	close(raw);
+
+	server.stop();
+	serving.join();
+
+	RemoteClient unreachable("127.0.0.1", server.get_port());
+	RenderDesc desc;
+	desc.width = 5;
+	desc.height = 4;
+	Frame frame = unreachable.submit(desc).get();
+	check(!unreachable && frame->size() == 20 && std::count(frame->begin(), frame->end(), char(Newton::NO_ROOT)) == 20,
+		"an unreachable server gives non-convergent frames");
 }
 
 int main() {
 	method_test();
 	test_calculate_polinomial();
 	test_calculate_derivative();
-}
\ No newline at end of file
+	non_convergent_test();
+
+	RenderService service(3, 5);
+	RenderServer server(0, 2);
+	std::thread serving(&RenderServer::serve, &server);
+	std::unique_ptr<RemoteClient> client(new RemoteClient("127.0.0.1", server.get_port()));
+	std::vector<Path> paths;
+	paths.push_back(Path{ "render_columns", [](const RenderDesc &desc, std::vector<char> &draw) {
+		draw.assign(desc.width * desc.height, 0);
+		Newton::render_columns(desc, draw.data(), 0, desc.width);
+	} });
+	paths.push_back(Path{ "regions", [](const RenderDesc &desc, std::vector<char> &draw) {
+		draw.assign(desc.width * desc.height, 0);
+		int split_x = desc.width / 3, split_y = desc.height / 2;
+		int xs[3] = { 0, split_x, desc.width }, ys[3] = { 0, split_y, desc.height };
+		for (auto i = 0; i < 2; ++i) {
+			for (auto j = 0; j < 2; ++j) {
+				RenderDesc part = desc.region(xs[i], ys[j], xs[i + 1] - xs[i], ys[j + 1] - ys[j]);
+				std::vector<char> block(part.width * part.height);
+				Newton::render_columns(part, block.data(), 0, part.width);
+				for (auto x = 0; x < part.width; ++x) {
+					for (auto y = 0; y < part.height; ++y) {
+						draw[(xs[i] + x) * desc.height + ys[j] + y] = block[x * part.height + y];
+					}
+				}
+			}
+		}
+	} });
+	paths.push_back(Path{ "RenderService", [&service](const RenderDesc &desc, std::vector<char> &draw) {
+		draw = *service.submit(desc, RenderService::BATCH).get();
+	} });
+	paths.push_back(Path{ "Symmetry", [](const RenderDesc &desc, std::vector<char> &draw) {
+		draw.assign(desc.width * desc.height, 0);
+		Symmetry symmetry(desc);
+		symmetry.render_columns(desc, draw.data(), 0, desc.width);
+		symmetry.fill(desc, draw.data());
+	} });
+	paths.push_back(Path{ "Remote", [&client](const RenderDesc &desc, std::vector<char> &draw) {
+		draw = *client->submit(desc, 0).get();
+	} });
+	differential_test(paths, 60, 2022, random_desc);
+	differential_test(paths, 60, 2031, random_symmetric_desc);
+	differential_test(paths, 40, 2033, random_clustered_desc);
+	client.reset();
+	server.stop();
+	serving.join();
+	symmetry_test();
+	certify_test();
+	multiplicity_test();
+	sweep_test(10);
+	parameter_plane_test();
+	expression_test();
+	batch_test();
+	remote_test();
+
+	if (failures == 0)
+		std::cout << "All tests passed" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,331 @@
+#include "BatchRunner.h"
+#include "ParameterSweep.h"
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace{
+// Values of a rendered by one method_sweep pass; also the most frames a
+// single submission holds from the pool.
+const int SWEEP_GROUP = 8;
+// Largest frame (in pixels) and iteration count a job may ask for, the same
+// limits a render server applies.
+const long long MAX_PIXELS = 1ll << 26;
+const int MAX_ITERATIONS = 1 << 20;
+
+double seconds_since(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+// Parses "re,im".
+bool parse_complex(std::string const &text, complex &value){
+    std::istringstream in(text);
+    double re, im;
+    char comma;
+    if (!(in >> re >> comma >> im) || comma != ',' || !(in >> std::ws).eof()){
+        return false;
+    }
+    value = complex(re, im);
+    return true;
+}
+bool parse_option(std::string const &token, BatchJob &job, std::vector<complex> &a_values, std::string &error){
+    std::size_t equals = token.find('=');
+    std::string key = token.substr(0, equals), value = token.substr(equals + 1);
+    if (key == "a"){
+        a_values.clear();
+        std::istringstream list(value);
+        std::string item;
+        complex a;
+        while (std::getline(list, item, ';')){
+            if (!parse_complex(item, a)){
+                return false;
+            }
+            a_values.push_back(a);
+        }
+        return !a_values.empty();
+    }
+    if (key == "plane"){
+        job.plane = true;
+        return parse_complex(value, job.seed);
+    }
+    if (key == "f"){
+        job.expression = std::make_shared<Expression>(value);
+        error = job.expression->get_error();
+        return bool(*job.expression);
+    }
+    return false;
+}
+// "out.bmp" -> "out_3.bmp"
+std::string numbered(std::string const &output, int index){
+    std::size_t dot = output.rfind('.');
+    std::size_t slash = output.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)){
+        dot = output.size();
+    }
+    return output.substr(0, dot) + "_" + std::to_string(index) + output.substr(dot);
+}
+bool same_except_a(BatchJob const &lhs, BatchJob const &rhs){
+    RenderDesc desc = rhs.desc;
+    desc.a = lhs.desc.a;
+    return desc == lhs.desc && !rhs.plane && !rhs.expression;
+}
+void put_le(std::vector<unsigned char> &bytes, std::size_t pos, unsigned value, int size){
+    for (int i = 0; i < size; ++i){
+        bytes[pos + i] = (value >> (8 * i)) & 0xff;
+    }
+}
+}
+
+void BatchReport::print(std::ostream &out) const{
+    double rate = seconds > 0 ? images / seconds : 0;
+    out << images << " images (" << failed << " failed), " << pixels / 1e6 << " Mpixels in " << seconds << " s: "
+        << rate << " images/s, " << rate * 3600 << " images/hour, "
+        << (seconds > 0 ? pixels / 1e6 / seconds : 0) << " Mpixels/s; encoding took " << encode_seconds << " s"
+        << std::endl;
+}
+
+FramePool::FramePool(int size){
+    for (int i = 0; i < size; ++i){
+        free.push_back(std::make_shared<std::vector<char> >());
+    }
+}
+std::shared_ptr<std::vector<char> > FramePool::acquire(){
+    std::unique_lock<std::mutex> guard(lock);
+    returned.wait(guard, [this]{
+        return !free.empty();
+    });
+    std::shared_ptr<std::vector<char> > buffer = free.back();
+    free.pop_back();
+    return buffer;
+}
+void FramePool::release(std::shared_ptr<std::vector<char> > buffer){
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        free.push_back(buffer);
+    }
+    returned.notify_one();
+}
+
+// Two frames per worker keep every worker busy while the encoder holds a few;
+// a sweep group on top of that always fits.
+BatchRunner::BatchRunner(std::vector<Rgb> const &palette, Rgb non_convergent, unsigned threads):
+    service(threads), pool(2 * service.get_threads() + 2 + SWEEP_GROUP), palette(palette), non_convergent(non_convergent){}
+
+bool BatchRunner::read_jobs(std::istream &in, std::vector<BatchJob> &jobs, std::string &error){
+    std::string line;
+    for (int line_number = 1; std::getline(in, line); ++line_number){
+        std::istringstream fields(line);
+        BatchJob job;
+        if (!(fields >> job.output) || job.output[0] == '#'){
+            continue;
+        }
+        RenderDesc &desc = job.desc;
+        if (!(fields >> desc.width >> desc.height >> desc.number_of_iterations >> desc.c1.first >> desc.c1.second
+                     >> desc.c4.first >> desc.c4.second)){
+            error = "line " + std::to_string(line_number) + ": expected size, iterations and viewport";
+            return false;
+        }
+        desc.a = complex(1, 0);
+        std::vector<complex> a_values;
+        std::vector<double> numbers;
+        std::string token;
+        while (fields >> token){
+            if (token.find('=') != std::string::npos){
+                std::string reason;
+                if (!parse_option(token, job, a_values, reason)){
+                    error = "line " + std::to_string(line_number) + ": bad option '" + token + "'" +
+                            (reason.empty() ? "" : ": " + reason);
+                    return false;
+                }
+                continue;
+            }
+            char *end = nullptr;
+            numbers.push_back(std::strtod(token.c_str(), &end));
+            if (*end != 0){
+                error = "line " + std::to_string(line_number) + ": bad number '" + token + "'";
+                return false;
+            }
+        }
+        if ((numbers.empty() && !job.expression) || numbers.size() % 2 != 0 || numbers.size() > 200){
+            error = "line " + std::to_string(line_number) + ": expected 1 to 100 roots as re im pairs";
+            return false;
+        }
+        for (std::size_t i = 0; i < numbers.size(); i += 2){
+            desc.roots.push_back(std::make_pair(complex(numbers[i], numbers[i + 1]), char(i / 2)));
+        }
+        if (desc.width <= 0 || desc.height <= 0){
+            error = "line " + std::to_string(line_number) + ": size must be positive";
+            return false;
+        }
+        if (static_cast<long long>(desc.width) * desc.height > MAX_PIXELS){
+            error = "line " + std::to_string(line_number) + ": more than " + std::to_string(MAX_PIXELS) + " pixels";
+            return false;
+        }
+        if (desc.number_of_iterations < 0 || desc.number_of_iterations > MAX_ITERATIONS){
+            error = "line " + std::to_string(line_number) + ": iterations must be from 0 to " + std::to_string(MAX_ITERATIONS);
+            return false;
+        }
+        if (a_values.size() > 1 && (job.plane || job.expression)){
+            error = "line " + std::to_string(line_number) + ": several values of a need a job with roots";
+            return false;
+        }
+        if (a_values.size() == 1){
+            desc.a = a_values[0];
+        }
+        if (a_values.size() <= 1){
+            jobs.push_back(job);
+            continue;
+        }
+        for (std::size_t k = 0; k < a_values.size(); ++k){
+            BatchJob value = job;
+            value.output = numbered(job.output, k);
+            value.desc.a = a_values[k];
+            value.sweep = k == 0 ? a_values.size() : 1;
+            jobs.push_back(value);
+        }
+    }
+    return true;
+}
+void BatchRunner::encode_bmp(RenderDesc const &desc, std::vector<char> const &draw,
+                             std::vector<unsigned char> &bytes) const{
+    const int HEADER = 54;
+    int row = (3 * desc.width + 3) / 4 * 4;
+    bytes.assign(HEADER + row * desc.height, 0);
+    bytes[0] = 'B';
+    bytes[1] = 'M';
+    put_le(bytes, 2, bytes.size(), 4);
+    put_le(bytes, 10, HEADER, 4);
+    put_le(bytes, 14, 40, 4);
+    put_le(bytes, 18, desc.width, 4);
+    put_le(bytes, 22, desc.height, 4);
+    put_le(bytes, 26, 1, 2);
+    put_le(bytes, 28, 24, 2);
+    put_le(bytes, 34, row * desc.height, 4);
+    // BMP rows go bottom-up like the y of the frame; pixels are stored as BGR.
+    for (int y = 0; y < desc.height; ++y){
+        unsigned char *out = bytes.data() + HEADER + y * row;
+        for (int x = 0; x < desc.width; ++x, out += 3){
+            char color = draw[x * desc.height + y];
+            Rgb const &rgb = color < 0 || palette.empty() ? non_convergent : palette[color % palette.size()];
+            out[0] = rgb[2];
+            out[1] = rgb[1];
+            out[2] = rgb[0];
+        }
+    }
+}
+BatchReport BatchRunner::run(std::vector<BatchJob> const &jobs){
+    return run(jobs, [this](BatchJob const &job, std::vector<char> const &draw){
+        encode_bmp(job.desc, draw, encoded);
+        std::ofstream out(job.output, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+        return bool(out);
+    });
+}
+BatchReport BatchRunner::run(std::vector<BatchJob> const &jobs, Sink sink){
+    struct Submitted{
+        BatchJob const *job;
+        std::shared_ptr<std::vector<char> > buffer;
+        std::shared_future<Frame> frame;
+    };
+    std::deque<Submitted> submitted;
+    std::mutex lock;
+    std::condition_variable ready;
+    bool done = false;
+    BatchReport report = {0, 0, 0, 0, 0};
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread encoder([&]{
+        std::unique_lock<std::mutex> guard(lock);
+        while (true){
+            ready.wait(guard, [&]{
+                return done || !submitted.empty();
+            });
+            if (submitted.empty()){
+                return;
+            }
+            Submitted next = submitted.front();
+            submitted.pop_front();
+            guard.unlock();
+            // Frames of one sweep share the future of the pass that fills them.
+            next.frame.wait();
+            auto encode_start = std::chrono::steady_clock::now();
+            bool written = sink(*next.job, *next.buffer);
+            report.encode_seconds += seconds_since(encode_start);
+            report.failed += !written;
+            report.images += written;
+            report.pixels += next.buffer->size();
+            pool.release(next.buffer);
+            guard.lock();
+        }
+    });
+    // Jobs of a sweep longer than SWEEP_GROUP still to be rendered after jobs[i].
+    std::size_t sweep_rest = 0;
+    for (std::size_t i = 0; i < jobs.size();){
+        BatchJob const &job = jobs[i];
+        std::size_t sweep = sweep_rest > 0 ? sweep_rest : std::max(job.sweep, 1);
+        std::size_t group = 1;
+        while (group < std::min<std::size_t>(sweep, SWEEP_GROUP) && i + group < jobs.size() &&
+               same_except_a(job, jobs[i + group])){
+            ++group;
+        }
+        if (group > 1){
+            std::vector<std::shared_ptr<std::vector<char> > > buffers;
+            std::vector<complex> a_values;
+            std::vector<char *> draws;
+            for (std::size_t k = 0; k < group; ++k){
+                buffers.push_back(pool.acquire());
+                buffers.back()->resize(job.desc.width * job.desc.height);
+                a_values.push_back(jobs[i + k].desc.a);
+                draws.push_back(buffers.back()->data());
+            }
+            std::shared_future<Frame> frame = service.submit_columns(job.desc.width, job.desc.height,
+                                                                     [&job, a_values, draws](char *, int x_begin, int x_end){
+                method_sweep(job.desc, a_values, draws.data(), x_begin, x_end);
+            }, RenderService::BATCH, buffers[0]);
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                for (std::size_t k = 0; k < group; ++k){
+                    submitted.push_back(Submitted{&jobs[i + k], buffers[k], frame});
+                }
+            }
+            ready.notify_one();
+            sweep_rest = sweep > group ? sweep - group : 0;
+            i += group;
+            continue;
+        }
+        std::shared_ptr<std::vector<char> > buffer = pool.acquire();
+        std::shared_future<Frame> frame;
+        if (job.expression){
+            std::vector<complex> attractors = job.expression->find_attractors(job.desc);
+            frame = service.submit_columns(job.desc.width, job.desc.height,
+                                           [&job, attractors](char *draw, int x_begin, int x_end){
+                job.expression->render_columns(job.desc, attractors, draw, x_begin, x_end);
+            }, RenderService::BATCH, buffer);
+        }
+        else if (job.plane){
+            frame = service.submit_columns(job.desc.width, job.desc.height, [&job](char *draw, int x_begin, int x_end){
+                parameter_plane(job.desc, job.seed, draw, x_begin, x_end);
+            }, RenderService::BATCH, buffer);
+        }
+        else{
+            frame = service.submit(job.desc, RenderService::BATCH, -1, buffer);
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            submitted.push_back(Submitted{&job, buffer, frame});
+        }
+        ready.notify_one();
+        sweep_rest = 0;
+        ++i;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        done = true;
+    }
+    ready.notify_one();
+    encoder.join();
+    report.seconds = seconds_since(start);
+    return report;
+}
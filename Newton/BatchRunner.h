@@ -0,0 +1,95 @@
+#ifndef batch_runner
+#define batch_runner
+#include <array>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Newton.cpp"
+#include "RenderService.h"
+#include "Expression.h"
+
+struct BatchJob{
+    std::string output;
+    RenderDesc desc;
+    // Parameter plane: the viewport spans values of a, each iterated from seed.
+    bool plane = false;
+    complex seed;
+    // Newton fractal of this function instead of the polynomial of desc.roots;
+    // pixels are coloured by the attractors it finds in the viewport.
+    std::shared_ptr<Expression> expression;
+    // This job and the sweep - 1 jobs after it differ only in desc.a and are
+    // rendered together in one pass of method_sweep.
+    int sweep = 1;
+};
+
+struct BatchReport{
+    int images;
+    int failed;
+    long long pixels;
+    double seconds;
+    double encode_seconds;
+    void print(std::ostream &out) const;
+};
+
+// Fixed set of frame buffers that are allocated once and handed out again and
+// again. acquire() blocks while every buffer is in flight, which also bounds
+// how far rendering may run ahead of encoding.
+class FramePool{
+    std::vector<std::shared_ptr<std::vector<char> > > free;
+    std::mutex lock;
+    std::condition_variable returned;
+public:
+    FramePool(int size);
+    FramePool(FramePool const &src) = delete;
+    FramePool(FramePool &&src) = delete;
+    FramePool& operator=(FramePool const &rhs) = delete;
+    FramePool& operator=(FramePool &&rhs) = delete;
+    std::shared_ptr<std::vector<char> > acquire();
+    void release(std::shared_ptr<std::vector<char> > buffer);
+};
+
+// Renders a list of jobs on one persistent RenderService into pooled buffers,
+// while a separate thread encodes finished frames in job order, so image
+// encoding and file output overlap with the rendering of the next frames.
+//
+// A job list has one job per line, blank lines and lines starting with '#'
+// are skipped:
+//     output width height iterations left top right bottom [options] re im [re im ...]
+// The roots get the colours 0, 1, 2, ... in the order they are listed.
+// Options are written as key=value without spaces:
+//     a=RE,IM      relaxation parameter, 1 by default
+//     a=RE,IM;RE,IM;...
+//                  one image per value of a, computed in a single sweep and
+//                  written to output with _0, _1, ... before the extension
+//     plane=RE,IM  render the parameter plane of a for the starting point RE,IM
+//     f=EXPR       render the Newton fractal of EXPR, e.g. f=sin(z)*(z^3-1);
+//                  the roots may then be left out
+class BatchRunner{
+public:
+    using Rgb = std::array<unsigned char, 3>;
+    using Sink = std::function<bool(BatchJob const &, std::vector<char> const &)>;
+private:
+    RenderService service;
+    FramePool pool;
+    std::vector<Rgb> palette;
+    Rgb non_convergent;
+    std::vector<unsigned char> encoded;
+public:
+    BatchRunner(std::vector<Rgb> const &palette, Rgb non_convergent, unsigned threads = 0);
+    BatchRunner(BatchRunner const &src) = delete;
+    BatchRunner(BatchRunner &&src) = delete;
+    BatchRunner& operator=(BatchRunner const &rhs) = delete;
+    BatchRunner& operator=(BatchRunner &&rhs) = delete;
+    static bool read_jobs(std::istream &in, std::vector<BatchJob> &jobs, std::string &error);
+    // Encodes a frame as a 24-bit BMP into bytes, reusing its storage.
+    void encode_bmp(RenderDesc const &desc, std::vector<char> const &draw, std::vector<unsigned char> &bytes) const;
+    // Writes every frame to job.output as BMP.
+    BatchReport run(std::vector<BatchJob> const &jobs);
+    // Hands every frame to sink instead; a false result counts as a failed job.
+    BatchReport run(std::vector<BatchJob> const &jobs, Sink sink);
+};
+#endif
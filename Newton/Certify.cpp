@@ -0,0 +1,144 @@
+#include "Certify.h"
+#include <algorithm>
+#include <cmath>
+
+namespace{
+// Relative slack added to every enclosure to cover rounding errors.
+const double SLACK = 1e-12;
+
+// Disk arithmetic: every operation returns a disk that contains all results
+// of the operation applied to points of its operands.
+struct Disk{
+    complex centre;
+    double radius;
+};
+Disk operator*(Disk const &lhs, Disk const &rhs){
+    return Disk({lhs.centre * rhs.centre, std::abs(lhs.centre) * rhs.radius + std::abs(rhs.centre) * lhs.radius +
+                                          lhs.radius * rhs.radius});
+}
+Disk operator+(complex lhs, Disk const &rhs){
+    return Disk({lhs + rhs.centre, rhs.radius});
+}
+// Only defined when the disk does not contain zero.
+Disk inverse(Disk const &disk){
+    double modulus = std::abs(disk.centre);
+    return Disk({1.0 / disk.centre, disk.radius / (modulus * (modulus - disk.radius))});
+}
+}
+
+TileCertifier::TileCertifier(const RenderDesc &desc): roots(desc.roots), a(desc.a),
+                                                     number_of_iterations(desc.number_of_iterations){
+    scale = Newton::root_scale(roots);
+    // |N(z) - r| <= |z - r| (|1 - a| + t) / (1 - t) with t = R * sum 1 / (d_k - R)
+    // over the other roots, which contracts as long as t < (1 - |1 - a|) / 2.
+    double limit = (1 - std::abs(1.0 - a)) / 2;
+    for (std::size_t j = 0; j < roots.size(); ++j){
+        double closest = -1;
+        for (std::size_t k = 0; k < roots.size(); ++k){
+            double distance = std::abs(roots[j].first - roots[k].first);
+            if (k != j && (closest < 0 || distance < closest)){
+                closest = distance;
+            }
+        }
+        double radius = 1e3 * scale;
+        if (closest >= 0){
+            // The largest admissible radius below a third of the distance to
+            // the closest root, by bisection.
+            double low = 0, high = closest / 3;
+            for (int step = 0; step < 50; ++step){
+                double middle = (low + high) / 2, t = 0;
+                for (std::size_t k = 0; k < roots.size(); ++k){
+                    if (k != j){
+                        t += middle / (std::abs(roots[j].first - roots[k].first) - middle);
+                    }
+                }
+                (t < limit ? low : high) = middle;
+            }
+            radius = low;
+        }
+        contraction.push_back(limit > 0 && closest != 0 ? radius * (1 - 1e-6) : 0);
+        colors.push_back(roots[Newton::cluster_representative(roots, j, Newton::coincidence_tolerance(roots))].second);
+    }
+}
+char TileCertifier::certify(complex centre, double radius) const{
+    if (roots.empty()){
+        return Newton::PENDING;
+    }
+    double modulus_a = std::abs(a);
+    for (int idx = 0; ; ++idx){
+        for (std::size_t j = 0; j < roots.size(); ++j){
+            if (std::abs(centre - roots[j].first) + radius <= contraction[j]){
+                return colors[j];
+            }
+        }
+        if (idx == number_of_iterations){
+            return Newton::PENDING;
+        }
+        // Near the closest root r write u = z - r and S = sum 1 / (z - r_k) over
+        // the other roots, so that N(z) = z - a u / (1 + u S) and
+        // N'(z) = 1 + a (u^2 S' - 1) / (1 + u S)^2, with S' = -sum 1 / (z - r_k)^2.
+        std::size_t closest = 0;
+        for (std::size_t j = 1; j < roots.size(); ++j){
+            if (std::abs(centre - roots[j].first) < std::abs(centre - roots[closest].first)){
+                closest = j;
+            }
+        }
+        Disk u({centre - roots[closest].first, radius});
+        Disk others({0, 0}), slope_others({0, 0});
+        for (std::size_t k = 0; k < roots.size(); ++k){
+            if (k == closest){
+                continue;
+            }
+            complex v = centre - roots[k].first;
+            double d = std::abs(v);
+            if (d <= radius){
+                return Newton::PENDING;
+            }
+            others.centre += 1.0 / v;
+            others.radius += radius / (d * (d - radius));
+            slope_others.centre -= 1.0 / (v * v);
+            slope_others.radius += radius * (2 * d + radius) / (d * d * (d - radius) * (d - radius));
+        }
+        Disk denominator = complex(1, 0) + u * others;
+        if (std::abs(denominator.centre) <= denominator.radius){
+            return Newton::PENDING;
+        }
+        Disk inverse_denominator = inverse(denominator);
+        Disk ratio = (complex(-1, 0) + u * u * slope_others) * inverse_denominator * inverse_denominator;
+        Disk slope = complex(1, 0) + Disk({a * ratio.centre, modulus_a * ratio.radius});
+        double stretch = std::abs(slope.centre) + slope.radius;
+        centre -= a * u.centre / (1.0 + u.centre * others.centre);
+        radius = radius * stretch * (1 + SLACK) + SLACK * (std::abs(centre) + scale);
+        if (!std::isfinite(radius) || radius > 1e3 * scale){
+            return Newton::PENDING;
+        }
+    }
+}
+void TileCertifier::certify_block(const RenderDesc &desc, char *draw, int x, int y, int w, int h) const{
+    double fraction_x = (desc.c4.first - desc.c1.first) / desc.width;
+    double fraction_y = (desc.c1.second - desc.c4.second) / desc.height;
+    // Disk around the centres of the pixels of the block.
+    complex low(desc.c1.first + fraction_x * (0.5 + x), desc.c4.second + fraction_y * (0.5 + y));
+    complex high(desc.c1.first + fraction_x * (w - 0.5 + x), desc.c4.second + fraction_y * (h - 0.5 + y));
+    char color = certify((low + high) / 2.0, std::abs(high - low) / 2 * (1 + SLACK));
+    if (color == Newton::PENDING && (w > MIN_TILE || h > MIN_TILE)){
+        int half_w = w > MIN_TILE ? w / 2 : w;
+        int half_h = h > MIN_TILE ? h / 2 : h;
+        for (int i = x; i < x + w; i += half_w){
+            for (int j = y; j < y + h; j += half_h){
+                certify_block(desc, draw, i, j, std::min(half_w, x + w - i), std::min(half_h, y + h - j));
+            }
+        }
+        return;
+    }
+    for (int i = x; i < x + w; ++i){
+        std::fill(draw + i * desc.height + y, draw + i * desc.height + y + h, color);
+    }
+}
+void TileCertifier::render_columns(const RenderDesc &desc, char *draw, int x_begin, int x_end) const{
+    for (int x = x_begin; x < x_end; x += TILE){
+        for (int y = 0; y < desc.height; y += TILE){
+            certify_block(desc, draw, x, y, std::min<int>(TILE, x_end - x), std::min<int>(TILE, desc.height - y));
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef tile_certifier
+#define tile_certifier
+#include <vector>
+#include "Newton.cpp"
+
+// Proves with disk arithmetic that a whole tile of the viewport converges to
+// one root, so the tile can be filled without iterating its pixels.
+//
+// Around every root r there is a disk D(r, R) that the relaxed Newton map
+// contracts into itself; all of its points converge to r and r is the closest
+// root to each of them. A disk enclosing the tile is pushed through the Newton
+// map with an enclosure of N' bounding how much it can grow. When one of the
+// enclosures lands inside such a contraction disk within the iteration limit,
+// every pixel of the tile gets the colour of r, exactly as the per-pixel
+// iteration would give. Tiles that cannot be certified are split in four,
+// down to MIN_TILE pixels, and what is left is iterated pixel by pixel.
+class TileCertifier{
+    std::vector<std::pair<complex, char> > roots;
+    std::vector<double> contraction;
+    std::vector<char> colors;
+    complex a;
+    int number_of_iterations;
+    double scale;
+    void certify_block(const RenderDesc &desc, char *draw, int x, int y, int w, int h) const;
+public:
+    enum {TILE = 16, MIN_TILE = 4};
+    TileCertifier(const RenderDesc &desc);
+    // Colour of the root that every point of the disk reaches, or Newton::PENDING.
+    char certify(complex centre, double radius) const;
+    // Fills the cells of the columns [x_begin, x_end) that lie in certified
+    // tiles and marks the others PENDING.
+    void render_columns(const RenderDesc &desc, char *draw, int x_begin, int x_end) const;
+};
+#endif
@@ -0,0 +1,481 @@
+#include "Expression.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+
+namespace{
+const double PI = 3.14159265358979323846;
+// Largest integer exponent that is expanded into multiplications.
+const int MAX_POWI = 64;
+// Largest number of attractors, so that their indices fit into a pixel.
+const std::size_t MAX_ATTRACTORS = 120;
+
+void skip_spaces(std::string const &source, std::size_t &pos){
+    while (pos < source.size() && std::isspace(static_cast<unsigned char>(source[pos]))){
+        ++pos;
+    }
+}
+bool starts_primary(std::string const &source, std::size_t pos){
+    return pos < source.size() && (std::isalnum(static_cast<unsigned char>(source[pos])) ||
+                                   source[pos] == '.' || source[pos] == '(');
+}
+bool is_converged(complex step, complex z){
+    return std::abs(step) < 1e-10 * (1 + std::abs(z));
+}
+}
+
+struct Expression::Node{
+    enum Kind {CONSTANT, VARIABLE, FUNCTION, BINARY};
+    Kind kind;
+    complex value;
+    char op;
+    std::string function;
+    std::shared_ptr<Node> lhs;
+    std::shared_ptr<Node> rhs;
+};
+
+Expression::Expression(std::string const &source): registers(1), value(-1), derivative(-1){
+    std::size_t pos = 0;
+    std::shared_ptr<Node> tree = parse_sum(source, pos);
+    skip_spaces(source, pos);
+    if (tree && pos != source.size()){
+        error = "unexpected '" + source.substr(pos, 1) + "' at " + std::to_string(pos);
+    }
+    if (!error.empty()){
+        return;
+    }
+    std::pair<int, int> result = compile(tree);
+    value = result.first;
+    derivative = result.second;
+}
+Expression::operator bool() const{
+    return error.empty();
+}
+std::string const & Expression::get_error() const{
+    return error;
+}
+int Expression::get_code_size() const{
+    return code.size();
+}
+
+std::shared_ptr<Expression::Node> Expression::parse_sum(std::string const &source, std::size_t &pos){
+    std::shared_ptr<Node> lhs = parse_product(source, pos);
+    skip_spaces(source, pos);
+    while (lhs && pos < source.size() && (source[pos] == '+' || source[pos] == '-')){
+        char op = source[pos++];
+        std::shared_ptr<Node> rhs = parse_product(source, pos);
+        if (!rhs){
+            return rhs;
+        }
+        lhs = std::shared_ptr<Node>(new Node({Node::BINARY, 0, op, "", lhs, rhs}));
+        skip_spaces(source, pos);
+    }
+    return lhs;
+}
+// Products also allow implicit multiplication, as in "2z" or "3 sin(z)".
+std::shared_ptr<Expression::Node> Expression::parse_product(std::string const &source, std::size_t &pos){
+    std::shared_ptr<Node> lhs = parse_unary(source, pos);
+    skip_spaces(source, pos);
+    while (lhs && pos < source.size() && (source[pos] == '*' || source[pos] == '/' || starts_primary(source, pos))){
+        char op = source[pos] == '/' ? '/' : '*';
+        if (source[pos] == '*' || source[pos] == '/'){
+            ++pos;
+        }
+        std::shared_ptr<Node> rhs = parse_unary(source, pos);
+        if (!rhs){
+            return rhs;
+        }
+        lhs = std::shared_ptr<Node>(new Node({Node::BINARY, 0, op, "", lhs, rhs}));
+        skip_spaces(source, pos);
+    }
+    return lhs;
+}
+std::shared_ptr<Expression::Node> Expression::parse_unary(std::string const &source, std::size_t &pos){
+    skip_spaces(source, pos);
+    if (pos < source.size() && (source[pos] == '-' || source[pos] == '+')){
+        char op = source[pos++];
+        std::shared_ptr<Node> operand = parse_unary(source, pos);
+        if (!operand || op == '+'){
+            return operand;
+        }
+        return std::shared_ptr<Node>(new Node({Node::FUNCTION, 0, 0, "-", operand, nullptr}));
+    }
+    return parse_power(source, pos);
+}
+// "^" binds tighter than a leading minus and groups to the right: -z^2^3 = -(z^(2^3)).
+std::shared_ptr<Expression::Node> Expression::parse_power(std::string const &source, std::size_t &pos){
+    std::shared_ptr<Node> base = parse_primary(source, pos);
+    skip_spaces(source, pos);
+    if (base && pos < source.size() && source[pos] == '^'){
+        ++pos;
+        std::shared_ptr<Node> exponent = parse_unary(source, pos);
+        if (!exponent){
+            return exponent;
+        }
+        return std::shared_ptr<Node>(new Node({Node::BINARY, 0, '^', "", base, exponent}));
+    }
+    return base;
+}
+std::shared_ptr<Expression::Node> Expression::parse_primary(std::string const &source, std::size_t &pos){
+    skip_spaces(source, pos);
+    if (pos >= source.size()){
+        error = "unexpected end of expression";
+        return nullptr;
+    }
+    if (source[pos] == '('){
+        ++pos;
+        std::shared_ptr<Node> inner = parse_sum(source, pos);
+        skip_spaces(source, pos);
+        if (inner && (pos >= source.size() || source[pos] != ')')){
+            error = "missing ')' at " + std::to_string(pos);
+            return nullptr;
+        }
+        ++pos;
+        return inner;
+    }
+    if (std::isdigit(static_cast<unsigned char>(source[pos])) || source[pos] == '.'){
+        char *end = nullptr;
+        double number = std::strtod(source.c_str() + pos, &end);
+        if (end == source.c_str() + pos){
+            error = "bad number at " + std::to_string(pos);
+            return nullptr;
+        }
+        pos = end - source.c_str();
+        return std::shared_ptr<Node>(new Node({Node::CONSTANT, number, 0, "", nullptr, nullptr}));
+    }
+    std::size_t start = pos;
+    while (pos < source.size() && std::isalpha(static_cast<unsigned char>(source[pos]))){
+        ++pos;
+    }
+    std::string name = source.substr(start, pos - start);
+    if (name == "z"){
+        return std::shared_ptr<Node>(new Node({Node::VARIABLE, 0, 0, "", nullptr, nullptr}));
+    }
+    if (name == "i" || name == "pi" || name == "e"){
+        complex number = name == "i" ? complex(0, 1) : name == "pi" ? complex(PI, 0) : complex(std::exp(1.0), 0);
+        return std::shared_ptr<Node>(new Node({Node::CONSTANT, number, 0, "", nullptr, nullptr}));
+    }
+    static const char *functions[] = {"sin", "cos", "tan", "sinh", "cosh", "exp", "log", "sqrt"};
+    if (std::find(std::begin(functions), std::end(functions), name) == std::end(functions)){
+        error = name.empty() ? "unexpected '" + source.substr(start, 1) + "' at " + std::to_string(start)
+                             : "unknown name '" + name + "'";
+        return nullptr;
+    }
+    skip_spaces(source, pos);
+    if (pos >= source.size() || source[pos] != '('){
+        error = "missing '(' after " + name;
+        return nullptr;
+    }
+    std::shared_ptr<Node> argument = parse_primary(source, pos);
+    if (!argument){
+        return argument;
+    }
+    return std::shared_ptr<Node>(new Node({Node::FUNCTION, 0, 0, name, argument, nullptr}));
+}
+
+int Expression::constant(complex c){
+    for (auto it = constants.begin(); it != constants.end(); ++it){
+        if (it->second == c){
+            return it->first;
+        }
+    }
+    constants.push_back(std::make_pair(registers, c));
+    return registers++;
+}
+int Expression::emit(OpCode op, int lhs, int rhs){
+    code.push_back(Instruction({op, registers, lhs, rhs, 0}));
+    return registers++;
+}
+int Expression::emit_power(int lhs, int power){
+    code.push_back(Instruction({POWI, registers, lhs, -1, power}));
+    return registers++;
+}
+// Derivative registers are -1 where the derivative is known to be zero;
+// these helpers skip the instructions that would only add or multiply zeros.
+int Expression::emit_sum(int lhs, int rhs){
+    if (lhs < 0 || rhs < 0){
+        return lhs < 0 ? rhs : lhs;
+    }
+    return emit(ADD, lhs, rhs);
+}
+int Expression::emit_product(int lhs, int rhs){
+    if (lhs < 0 || rhs < 0){
+        return -1;
+    }
+    return emit(MUL, lhs, rhs);
+}
+// Returns the registers holding the value of node and its derivative by z.
+std::pair<int, int> Expression::compile(std::shared_ptr<Node> const &node){
+    if (node->kind == Node::CONSTANT){
+        return std::make_pair(constant(node->value), -1);
+    }
+    if (node->kind == Node::VARIABLE){
+        return std::make_pair(0, constant(1));
+    }
+    std::pair<int, int> a = compile(node->lhs);
+    if (node->kind == Node::FUNCTION){
+        std::string const &name = node->function;
+        if (name == "-"){
+            return std::make_pair(emit(NEG, a.first), a.second < 0 ? -1 : emit(NEG, a.second));
+        }
+        if (name == "sin"){
+            int v = emit(SIN, a.first);
+            return std::make_pair(v, a.second < 0 ? -1 : emit_product(emit(COS, a.first), a.second));
+        }
+        if (name == "cos"){
+            int v = emit(COS, a.first);
+            return std::make_pair(v, a.second < 0 ? -1 : emit_product(emit(NEG, emit(SIN, a.first)), a.second));
+        }
+        if (name == "tan"){
+            int v = emit(TAN, a.first);
+            return std::make_pair(v, a.second < 0 ? -1 : emit_product(emit(ADD, constant(1), emit(MUL, v, v)), a.second));
+        }
+        if (name == "sinh"){
+            int v = emit(SINH, a.first);
+            return std::make_pair(v, a.second < 0 ? -1 : emit_product(emit(COSH, a.first), a.second));
+        }
+        if (name == "cosh"){
+            int v = emit(COSH, a.first);
+            return std::make_pair(v, a.second < 0 ? -1 : emit_product(emit(SINH, a.first), a.second));
+        }
+        if (name == "exp"){
+            int v = emit(EXP, a.first);
+            return std::make_pair(v, emit_product(v, a.second));
+        }
+        if (name == "log"){
+            int v = emit(LOG, a.first);
+            return std::make_pair(v, a.second < 0 ? -1 : emit(DIV, a.second, a.first));
+        }
+        int v = emit(SQRT, a.first);
+        return std::make_pair(v, a.second < 0 ? -1 : emit(DIV, a.second, emit(ADD, v, v)));
+    }
+    if (node->op == '^' && node->rhs->kind == Node::CONSTANT && node->rhs->value.imag() == 0 &&
+        node->rhs->value.real() == std::round(node->rhs->value.real()) && std::abs(node->rhs->value.real()) <= MAX_POWI){
+        int n = node->rhs->value.real();
+        if (n == 0){
+            return std::make_pair(constant(1), -1);
+        }
+        int v = emit_power(a.first, n);
+        if (a.second < 0){
+            return std::make_pair(v, -1);
+        }
+        int lower = n == 1 ? constant(1) : emit_power(a.first, n - 1);
+        return std::make_pair(v, emit(MUL, emit(MUL, constant(n), lower), a.second));
+    }
+    std::pair<int, int> b = compile(node->rhs);
+    switch (node->op){
+    case '+':
+        return std::make_pair(emit(ADD, a.first, b.first), emit_sum(a.second, b.second));
+    case '-':{
+        int d = b.second < 0 ? a.second : a.second < 0 ? emit(NEG, b.second) : emit(SUB, a.second, b.second);
+        return std::make_pair(emit(SUB, a.first, b.first), d);
+    }
+    case '*':
+        return std::make_pair(emit(MUL, a.first, b.first),
+                              emit_sum(emit_product(a.second, b.first), emit_product(a.first, b.second)));
+    case '/':{
+        // (a / b)' = (a' - (a / b) b') / b
+        int v = emit(DIV, a.first, b.first);
+        int numerator = a.second;
+        if (b.second >= 0){
+            int t = emit(MUL, v, b.second);
+            numerator = a.second < 0 ? emit(NEG, t) : emit(SUB, a.second, t);
+        }
+        return std::make_pair(v, numerator < 0 ? -1 : emit(DIV, numerator, b.first));
+    }
+    default:{
+        // (a ^ b)' = a ^ b (b' log a + b a' / a)
+        int v = emit(POW, a.first, b.first);
+        int by_exponent = b.second < 0 ? -1 : emit(MUL, b.second, emit(LOG, a.first));
+        int by_base = a.second < 0 ? -1 : emit(MUL, b.first, emit(DIV, a.second, a.first));
+        return std::make_pair(v, emit_product(v, emit_sum(by_exponent, by_base)));
+    }
+    }
+}
+
+// Runs the bytecode on count lanes; register r of lane k lives at r * BATCH + k,
+// and register 0 must hold z.
+void Expression::run(double *re, double *im, int count) const{
+    for (auto it = constants.begin(); it != constants.end(); ++it){
+        std::fill(re + it->first * BATCH, re + it->first * BATCH + count, it->second.real());
+        std::fill(im + it->first * BATCH, im + it->first * BATCH + count, it->second.imag());
+    }
+    for (auto it = code.begin(); it != code.end(); ++it){
+        double *tr = re + it->target * BATCH, *ti = im + it->target * BATCH;
+        double const *ar = re + it->lhs * BATCH, *ai = im + it->lhs * BATCH;
+        double const *br = re + std::max(it->rhs, 0) * BATCH, *bi = im + std::max(it->rhs, 0) * BATCH;
+        switch (it->op){
+        case ADD:
+            for (int k = 0; k < count; ++k){
+                tr[k] = ar[k] + br[k]; ti[k] = ai[k] + bi[k];
+            }
+            break;
+        case SUB:
+            for (int k = 0; k < count; ++k){
+                tr[k] = ar[k] - br[k]; ti[k] = ai[k] - bi[k];
+            }
+            break;
+        case MUL:
+            for (int k = 0; k < count; ++k){
+                double r = ar[k] * br[k] - ai[k] * bi[k];
+                ti[k] = ar[k] * bi[k] + ai[k] * br[k];
+                tr[k] = r;
+            }
+            break;
+        case DIV:
+            for (int k = 0; k < count; ++k){
+                double den = br[k] * br[k] + bi[k] * bi[k];
+                double r = (ar[k] * br[k] + ai[k] * bi[k]) / den;
+                ti[k] = (ai[k] * br[k] - ar[k] * bi[k]) / den;
+                tr[k] = r;
+            }
+            break;
+        case NEG:
+            for (int k = 0; k < count; ++k){
+                tr[k] = -ar[k]; ti[k] = -ai[k];
+            }
+            break;
+        case POWI:
+            for (int k = 0; k < count; ++k){
+                complex base(ar[k], ai[k]), result(1, 0);
+                for (int n = std::abs(it->power); n > 0; n >>= 1){
+                    if (n & 1){
+                        result *= base;
+                    }
+                    base *= base;
+                }
+                if (it->power < 0){
+                    result = 1.0 / result;
+                }
+                tr[k] = result.real(); ti[k] = result.imag();
+            }
+            break;
+        default:
+            for (int k = 0; k < count; ++k){
+                complex a(ar[k], ai[k]), result;
+                switch (it->op){
+                case POW: result = std::pow(a, complex(br[k], bi[k])); break;
+                case SIN: result = std::sin(a); break;
+                case COS: result = std::cos(a); break;
+                case TAN: result = std::tan(a); break;
+                case SINH: result = std::sinh(a); break;
+                case COSH: result = std::cosh(a); break;
+                case EXP: result = std::exp(a); break;
+                case LOG: result = std::log(a); break;
+                default: result = std::sqrt(a); break;
+                }
+                tr[k] = result.real(); ti[k] = result.imag();
+            }
+        }
+    }
+}
+void Expression::evaluate(complex const *z, int count, complex *f, complex *df) const{
+    std::vector<double> re(registers * BATCH), im(registers * BATCH);
+    for (int k = 0; k < count; ++k){
+        re[k] = z[k].real();
+        im[k] = z[k].imag();
+    }
+    run(re.data(), im.data(), count);
+    for (int k = 0; k < count; ++k){
+        f[k] = complex(re[value * BATCH + k], im[value * BATCH + k]);
+        df[k] = derivative < 0 ? complex(0, 0) : complex(re[derivative * BATCH + k], im[derivative * BATCH + k]);
+    }
+}
+std::vector<complex> Expression::find_attractors(RenderDesc const &desc, int samples) const{
+    std::vector<complex> attractors;
+    RenderDesc grid = desc;
+    grid.width = grid.height = samples;
+    grid.number_of_iterations = std::max(desc.number_of_iterations, 100);
+    double fraction_x = (grid.c4.first - grid.c1.first) / samples;
+    double fraction_y = (grid.c1.second - grid.c4.second) / samples;
+    complex z[BATCH], f[BATCH], df[BATCH];
+    for (int first = 0; first < samples * samples; first += BATCH){
+        int count = std::min<int>(BATCH, samples * samples - first);
+        for (int k = 0; k < count; ++k){
+            int x = (first + k) / samples, y = (first + k) % samples;
+            z[k] = complex(grid.c1.first + fraction_x * (0.5 + x), grid.c4.second + fraction_y * (0.5 + y));
+        }
+        bool converged[BATCH] = {false};
+        for (int idx = 1; idx <= grid.number_of_iterations; ++idx){
+            evaluate(z, count, f, df);
+            for (int k = 0; k < count; ++k){
+                if (converged[k]){
+                    continue;
+                }
+                complex step = grid.a * f[k] / df[k];
+                z[k] -= step;
+                converged[k] = is_converged(step, z[k]);
+            }
+        }
+        for (int k = 0; k < count; ++k){
+            bool known = false;
+            for (auto it = attractors.begin(); it != attractors.end() && !known; ++it){
+                known = std::abs(*it - z[k]) < 1e-6 * (1 + std::abs(z[k]));
+            }
+            if (converged[k] && !known && attractors.size() < MAX_ATTRACTORS){
+                attractors.push_back(z[k]);
+            }
+        }
+    }
+    return attractors;
+}
+void Expression::render_columns(RenderDesc const &desc, std::vector<complex> const &attractors, char *draw,
+                                int x_begin, int x_end) const{
+    double fraction_x = (desc.c4.first - desc.c1.first) / desc.width;
+    double fraction_y = (desc.c1.second - desc.c4.second) / desc.height;
+    std::vector<double> re(registers * BATCH), im(registers * BATCH);
+    for (int x = x_begin; x < x_end; ++x){
+        for (int first = 0; first < desc.height; first += BATCH){
+            int count = std::min<int>(BATCH, desc.height - first);
+            bool active[BATCH];
+            char color[BATCH];
+            for (int k = 0; k < count; ++k){
+                re[k] = desc.c1.first + fraction_x * (0.5 + x);
+                im[k] = desc.c4.second + fraction_y * (0.5 + first + k);
+                active[k] = true;
+                color[k] = Newton::PENDING;
+            }
+            int remaining = count;
+            for (int idx = 1; idx <= desc.number_of_iterations && remaining > 0; ++idx){
+                run(re.data(), im.data(), count);
+                for (int k = 0; k < count; ++k){
+                    if (!active[k]){
+                        continue;
+                    }
+                    complex z(re[k], im[k]);
+                    complex f(re[value * BATCH + k], im[value * BATCH + k]);
+                    complex df = derivative < 0 ? complex(0, 0)
+                                                : complex(re[derivative * BATCH + k], im[derivative * BATCH + k]);
+                    complex step = desc.a * f / df;
+                    z -= step;
+                    if (!std::isfinite(z.real()) || !std::isfinite(z.imag())){
+                        color[k] = Newton::NO_ROOT;
+                        active[k] = false;
+                        --remaining;
+                        continue;
+                    }
+                    re[k] = z.real();
+                    im[k] = z.imag();
+                    if (is_converged(step, z)){
+                        active[k] = false;
+                        --remaining;
+                    }
+                }
+            }
+            for (int k = 0; k < count; ++k){
+                if (color[k] == Newton::PENDING){
+                    complex z(re[k], im[k]);
+                    color[k] = Newton::NO_ROOT;
+                    for (std::size_t j = 0; j < attractors.size(); ++j){
+                        if (std::abs(attractors[j] - z) < 1e-6 * (1 + std::abs(z))){
+                            color[k] = j;
+                            break;
+                        }
+                    }
+                }
+                draw[x * desc.height + first + k] = color[k];
+            }
+        }
+    }
+}
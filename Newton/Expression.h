@@ -0,0 +1,73 @@
+#ifndef expression_vm
+#define expression_vm
+#include <memory>
+#include <string>
+#include <vector>
+#include "Newton.cpp"
+
+// Newton fractals of an arbitrary analytic function f given as text, e.g.
+// "sin(z) * (z^3 - 1)" or "exp(z) - 2 + 1/z". The text is parsed once and
+// compiled into register bytecode that computes f together with f', which is
+// derived from the syntax tree by forward differentiation at compile time.
+//
+// The bytecode runs on batches of BATCH points: every instruction loops over
+// the whole batch, so the interpreter dispatch is paid once per batch instead
+// of once per pixel. The attractors are not given but found by iterating a
+// grid of sample points over the viewport.
+//
+// Supported: numbers, z, i, pi, e, + - * / ^, and the functions sin, cos, tan,
+// sinh, cosh, exp, log and sqrt.
+class Expression{
+public:
+    enum {BATCH = 64};
+private:
+    enum OpCode {ADD, SUB, MUL, DIV, NEG, POWI, POW, SIN, COS, TAN, SINH, COSH, EXP, LOG, SQRT};
+    struct Instruction{
+        OpCode op;
+        int target;
+        int lhs;
+        int rhs;
+        int power; // integer exponent of POWI, which has no rhs register
+    };
+    struct Node;
+    std::vector<std::pair<int, complex> > constants;
+    std::vector<Instruction> code;
+    int registers;
+    int value;
+    int derivative;
+    std::string error;
+
+    std::shared_ptr<Node> parse_sum(std::string const &source, std::size_t &pos);
+    std::shared_ptr<Node> parse_product(std::string const &source, std::size_t &pos);
+    std::shared_ptr<Node> parse_unary(std::string const &source, std::size_t &pos);
+    std::shared_ptr<Node> parse_power(std::string const &source, std::size_t &pos);
+    std::shared_ptr<Node> parse_primary(std::string const &source, std::size_t &pos);
+    int constant(complex c);
+    int emit(OpCode op, int lhs, int rhs = -1);
+    int emit_power(int lhs, int power);
+    int emit_sum(int lhs, int rhs);
+    int emit_product(int lhs, int rhs);
+    std::pair<int, int> compile(std::shared_ptr<Node> const &node);
+    void run(double *re, double *im, int count) const;
+public:
+    Expression(std::string const &source);
+    Expression(Expression const &src) = default;
+    Expression(Expression &&src) = default;
+    Expression& operator=(Expression const &rhs) = default;
+    Expression& operator=(Expression &&rhs) = default;
+    operator bool() const;
+    std::string const & get_error() const;
+    int get_code_size() const;
+
+    // f and f' at count <= BATCH points.
+    void evaluate(complex const *z, int count, complex *f, complex *df) const;
+    // Roots of f that attract points of the viewport, found from a
+    // samples x samples grid of starting points.
+    std::vector<complex> find_attractors(RenderDesc const &desc, int samples = 24) const;
+    // Renders the columns [x_begin, x_end) of the viewport of desc like
+    // Newton::render_columns; pixels get the index of their attractor or
+    // Newton::NO_ROOT. desc.roots is not used.
+    void render_columns(RenderDesc const &desc, std::vector<complex> const &attractors, char *draw,
+                        int x_begin, int x_end) const;
+};
+#endif
@@ -3,10 +3,66 @@
 #include<vector>
 #include<cmath>
 #include<fstream>
+#include<algorithm>
+
+#ifndef newton_engine
+#define newton_engine
 
 using complex = std::complex<double>;
 
+// Immutable description of one frame: everything Newton::render_columns needs,
+// so a frame can be computed without touching the state of a Newton object.
+struct RenderDesc {
+	std::vector<std::pair<complex, char>> roots;
+	std::pair<double, double> c1, c4;
+	int width;
+	int height;
+	int number_of_iterations;
+	complex a;
+	// Fill tiles that provably converge to one root without iterating their pixels.
+	bool certify_tiles = true;
+
+	bool operator==(const RenderDesc &rhs) const {
+		return roots == rhs.roots && c1 == rhs.c1 && c4 == rhs.c4 && width == rhs.width &&
+			height == rhs.height && number_of_iterations == rhs.number_of_iterations && a == rhs.a &&
+			certify_tiles == rhs.certify_tiles;
+	}
+	bool operator!=(const RenderDesc &rhs) const {
+		return !(*this == rhs);
+	}
+	// The w x h block of pixels whose bottom left pixel is (x, y). Its pixels
+	// sample the same points as the matching pixels of the whole frame.
+	RenderDesc region(int x, int y, int w, int h) const {
+		double fraction_x = (c4.first - c1.first) / width;
+		double fraction_y = (c1.second - c4.second) / height;
+		RenderDesc part = *this;
+		part.c1 = std::make_pair(c1.first + fraction_x * x, c4.second + fraction_y * (y + h));
+		part.c4 = std::make_pair(c1.first + fraction_x * (x + w), c4.second + fraction_y * y);
+		part.width = w;
+		part.height = h;
+		return part;
+	}
+};
+
+// Roots of one colour that lie within Newton::cluster_tolerance of each other
+// act like one root of higher multiplicity: Newton converges to them only
+// linearly unless the step is multiplied by the multiplicity. That is done
+// between inner and outer, i.e. where the cluster looks like a single multiple
+// root. Points within inner have reached the cluster. Close roots of different
+// colours get plain steps, since the scaled step does not keep the point in
+// the basin of the root it was heading for.
+struct RootCluster {
+	complex centre;
+	int multiplicity;
+	double inner;
+	double outer;
+};
+
 class Newton final{
+public:
+	// Colour of pixels that are not attracted by any root, and of cells that
+	// a multi-pass renderer has not filled in yet.
+	enum : char {NO_ROOT = -1, PENDING = -2};
 private:
 	std::pair<double, double> c1, c4;
 	int height;
@@ -15,6 +71,14 @@ private:
     int number_of_iterations;
 
 	complex calculate_polinomial(complex meaning) {
+		return calculate_polinomial(roots, meaning);
+	}
+
+	complex calculate_derivative(complex meaning) {
+		return calculate_derivative(roots, meaning);
+	}
+public:
+	static complex calculate_polinomial(const std::vector<std::pair<complex, char>> &roots, complex meaning) {
 		complex res(1, 0);
 		for (auto root_n = 0; root_n != roots.size(); root_n++) {
 			res *= (meaning - roots[root_n].first);
@@ -22,7 +86,7 @@ private:
 		return res;
 	}
 
-	complex calculate_derivative(complex meaning) {
+	static complex calculate_derivative(const std::vector<std::pair<complex, char>> &roots, complex meaning) {
 		complex derivative = complex(0, 0);
 		for (auto i = 0; i < roots.size(); ++i) {
 		    complex var = complex(1, 0);
@@ -35,7 +99,7 @@ private:
 		}
         return derivative;
 	}
-public:
+
 	Newton(std::pair<double, double> c1, std::pair<double, double> c4) :
 		c1(c1), c4(c4) {
 		height = 500;//-------------------------------------------------------
@@ -71,18 +135,193 @@ public:
 		}
 	}
 	
+	// Size of the root set, used to turn the tolerances below into distances.
+	static double root_scale(const std::vector<std::pair<complex, char>> &roots) {
+		double scale = 1;
+		for (auto root_n = 0; root_n != roots.size(); root_n++) {
+			scale = std::max(scale, abs(roots[root_n].first));
+		}
+		return scale;
+	}
+
+	// Roots closer than this are the same root to double precision and are
+	// merged into one attractor.
+	static double coincidence_tolerance(const std::vector<std::pair<complex, char>> &roots) {
+		return 1e-10 * root_scale(roots);
+	}
+
+	// Roots of one colour closer than this are stepped towards as one multiple
+	// root.
+	static double cluster_tolerance(const std::vector<std::pair<complex, char>> &roots) {
+		return 1e-3 * root_scale(roots);
+	}
+
+	// Index of the first root within tolerance of roots[index]; its colour is
+	// the colour of the whole group.
+	static int cluster_representative(const std::vector<std::pair<complex, char>> &roots, int index, double tolerance) {
+		for (auto root_n = 0; root_n < index; root_n++) {
+			if (abs(roots[root_n].first - roots[index].first) < tolerance) {
+				return root_n;
+			}
+		}
+		return index;
+	}
+
+	// Clusters of two or more roots.
+	static std::vector<RootCluster> find_clusters(const std::vector<std::pair<complex, char>> &roots) {
+		std::vector<RootCluster> clusters;
+		double tolerance = cluster_tolerance(roots);
+		for (auto first = 0; first != roots.size(); first++) {
+			RootCluster cluster = {complex(0, 0), 0, 0, -1};
+			char color = find_closest_root(roots, roots[first].first).second;
+			bool same_color = true;
+			for (auto root_n = first; root_n != roots.size(); root_n++) {
+				if (cluster_representative(roots, root_n, tolerance) == first) {
+					cluster.centre += roots[root_n].first;
+					cluster.multiplicity++;
+					same_color &= find_closest_root(roots, roots[root_n].first).second == color;
+				}
+			}
+			if (cluster.multiplicity < 2 || !same_color) {
+				continue;
+			}
+			cluster.centre /= double(cluster.multiplicity);
+			for (auto root_n = 0; root_n != roots.size(); root_n++) {
+				double distance = abs(roots[root_n].first - cluster.centre);
+				if (cluster_representative(roots, root_n, tolerance) == first) {
+					cluster.inner = std::max(cluster.inner, 4 * distance);
+				}
+				else if (cluster.outer < 0 || distance / 3 < cluster.outer) {
+					cluster.outer = distance / 3;
+				}
+			}
+			if (cluster.outer < 0) {
+				cluster.outer = 1e15 * root_scale(roots);
+			}
+			clusters.push_back(cluster);
+		}
+		return clusters;
+	}
+
+	// Iterates one starting point like method() does, but stops as soon as the
+	// outcome is known. Converged points get the colour of the closest root;
+	// points caught in a cycle (Brent's algorithm), hitting a critical point,
+	// escaping to infinity or still far from every root when the iterations
+	// run out get NO_ROOT. Near a cluster of roots the step is
+	// scaled by its multiplicity, which restores quadratic convergence; once
+	// inside the cluster the point stops at the closest root, since plain
+	// Newton steps next to the critical point between nearly coincident roots
+	// throw it far away.
+	static char calculate_pixel(const RenderDesc &desc, complex z, double scale, const std::vector<RootCluster> &clusters) {
+		const double converged = 1e-10 * scale, cycle = 1e-9 * scale, diverged = 1e15 * scale, settled = 1e-6 * scale;
+		// Relative to the current step, so cycles are caught as soon as the
+		// orbit repeats itself to about three digits.
+		const double cycle_ratio = 1e-3;
+		const double rate = abs(1.0 - desc.a);
+		complex saved = z;
+		int power = 1, lambda = 0;
+		for (auto idx = 1; idx <= desc.number_of_iterations; ++idx) {
+			double multiplicity = 1;
+			for (auto cluster = clusters.begin(); cluster != clusters.end(); ++cluster) {
+				double distance = abs(z - cluster->centre);
+				if (distance <= cluster->inner) {
+					return find_closest_root(desc.roots, z).second;
+				}
+				if (distance < cluster->outer) {
+					// Relaxed steps contract by |1 - a| with the multiplicity
+					// applied and by |1 - a / m| without it; take the faster.
+					if (rate < abs(1.0 - desc.a / double(cluster->multiplicity))) {
+						multiplicity = cluster->multiplicity;
+					}
+					break;
+				}
+			}
+			complex polinomial = calculate_polinomial(desc.roots, z);
+			if (polinomial == complex(0, 0)) {
+				break;
+			}
+			complex step = multiplicity * desc.a * (polinomial / calculate_derivative(desc.roots, z));
+			z = z - step;
+			if (!std::isfinite(z.real()) || !std::isfinite(z.imag()) || norm(z) > diverged * diverged) {
+				return NO_ROOT;
+			}
+			if (norm(step) < converged * converged) {
+				break;
+			}
+			// Back near an earlier point: either a linearly converging orbit
+			// (relaxed a), whose distance to the root is at most
+			// |z - saved| / (1 - |1 - a|), or a cycle of period > 1 away from
+			// every root.
+			double repeat = abs(z - saved);
+			if (repeat < std::max(cycle, cycle_ratio * abs(step))) {
+				std::pair<complex, char> closest = find_closest_root(desc.roots, z);
+				double near_root = rate < 1 ? std::max(repeat, cycle) / std::max(1 - rate, 1e-6) : cycle;
+				if (abs(z - closest.first) < std::max(near_root, settled)) {
+					return closest.second;
+				}
+				return NO_ROOT;
+			}
+			if (++lambda == power) {
+				saved = z;
+				power *= 2;
+				lambda = 0;
+			}
+			if (idx == desc.number_of_iterations) {
+				std::pair<complex, char> closest = find_closest_root(desc.roots, z);
+				return abs(z - closest.first) < settled ? closest.second : char(NO_ROOT);
+			}
+		}
+		return find_closest_root(desc.roots, z).second;
+	}
+
+	// Renders the columns [x_begin, x_end) of a descriptor with calculate_pixel,
+	// so independent column stripes can run in parallel.
+	// draw must hold width * height cells, laid out like the output of method().
+	static void render_columns(const RenderDesc &desc, char *draw, int x_begin, int x_end) {
+		double fraction_x = (desc.c4.first - desc.c1.first) / desc.width;
+		double fraction_y = (desc.c1.second - desc.c4.second) / desc.height;
+		double scale = root_scale(desc.roots);
+		std::vector<RootCluster> clusters = find_clusters(desc.roots);
+		for (auto x = x_begin; x < x_end; x ++) {
+			for (auto y = 0; y < desc.height; y ++) {
+				complex z = complex(desc.c1.first + fraction_x * (0.5 + x), desc.c4.second + fraction_y * (0.5 + y));
+				draw[x * desc.height + y] = calculate_pixel(desc, z, scale, clusters);
+			}
+		}
+	}
+
+	RenderDesc describe(complex a = complex(1, 0)) {
+		RenderDesc desc;
+		desc.roots = roots;
+		desc.c1 = c1;
+		desc.c4 = c4;
+		desc.width = width;
+		desc.height = height;
+		desc.number_of_iterations = number_of_iterations;
+		desc.a = a;
+		return desc;
+	}
+
 	std::pair<complex, char> find_closest_root(complex meaning) {
+		return find_closest_root(roots, meaning);
+	}
+
+	// Closest root to meaning, with the colour of the first root coinciding
+	// with it, so repeated roots form one basin.
+	static std::pair<complex, char> find_closest_root(const std::vector<std::pair<complex, char>> &roots, complex meaning) {
 		double min = -1;
-		complex this_root = 0;
-		char color = 0;
+		int closest = 0;
 		for (auto iter = 0; iter != roots.size(); iter++) {
 			if (min > abs(meaning - roots[iter].first) || min < 0) {
 				min = abs(meaning - roots[iter].first);
-				this_root = roots[iter].first;
-				color = roots[iter].second;
+				closest = iter;
 			}
 		}
-		return std::make_pair(this_root, color);
+		if (roots.empty()) {
+			return std::make_pair(complex(0, 0), char(0));
+		}
+		int representative = cluster_representative(roots, closest, coincidence_tolerance(roots));
+		return std::make_pair(roots[closest].first, roots[representative].second);
 	}
 	
 	void move_root(char color, std::pair<double, double> new_r) {
@@ -104,5 +343,13 @@ public:
     std::pair<int, int> get_dimensions(){
         return {width, height};
     }  
+	void set_dimensions(int new_width, int new_height) {
+		width = new_width;
+		height = new_height;
+	}
+	void set_iterations(int iterations) {
+		number_of_iterations = iterations;
+	}
 
 };
+#endif
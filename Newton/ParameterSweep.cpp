@@ -0,0 +1,127 @@
+#include "ParameterSweep.h"
+#include <algorithm>
+
+namespace{
+const int LANES = 8;
+
+// Lanes of points z and parameters a in split real/imaginary arrays.
+struct Lanes{
+    double zr[LANES], zi[LANES];
+    double ar[LANES], ai[LANES];
+};
+
+// z = z - a * p(z) / p'(z) for every lane, number_of_iterations times.
+// p and p' are built together root by root: (p * u)' = p' * u + p.
+void iterate(Lanes &lanes, const std::vector<std::pair<complex, char> > &roots, int number_of_iterations){
+    for (int idx = 1; idx <= number_of_iterations; ++idx){
+        double pr[LANES], pi[LANES], dr[LANES], di[LANES];
+        for (int k = 0; k < LANES; ++k){
+            pr[k] = 1; pi[k] = 0; dr[k] = 0; di[k] = 0;
+        }
+        for (auto root = roots.begin(); root != roots.end(); ++root){
+            double rr = root->first.real(), ri = root->first.imag();
+            for (int k = 0; k < LANES; ++k){
+                double ur = lanes.zr[k] - rr, ui = lanes.zi[k] - ri;
+                double ndr = dr[k] * ur - di[k] * ui + pr[k];
+                double ndi = dr[k] * ui + di[k] * ur + pi[k];
+                double npr = pr[k] * ur - pi[k] * ui;
+                double npi = pr[k] * ui + pi[k] * ur;
+                dr[k] = ndr; di[k] = ndi; pr[k] = npr; pi[k] = npi;
+            }
+        }
+        for (int k = 0; k < LANES; ++k){
+            double den = dr[k] * dr[k] + di[k] * di[k];
+            double qr = (pr[k] * dr[k] + pi[k] * di[k]) / den;
+            double qi = (pi[k] * dr[k] - pr[k] * di[k]) / den;
+            lanes.zr[k] -= lanes.ar[k] * qr - lanes.ai[k] * qi;
+            lanes.zi[k] -= lanes.ar[k] * qi + lanes.ai[k] * qr;
+        }
+    }
+}
+
+void load_parameters(Lanes &lanes, const std::vector<complex> &a_values, std::size_t first){
+    for (int k = 0; k < LANES; ++k){
+        complex a = a_values[std::min(first + k, a_values.size() - 1)];
+        lanes.ar[k] = a.real();
+        lanes.ai[k] = a.imag();
+    }
+}
+}
+
+void method_sweep(const RenderDesc &desc, const std::vector<complex> &a_values,
+                  std::vector<std::vector<char> > &draws){
+    draws.resize(a_values.size());
+    std::vector<char *> targets;
+    for (auto it = draws.begin(); it != draws.end(); ++it){
+        it->resize(desc.width * desc.height);
+        targets.push_back(it->data());
+    }
+    method_sweep(desc, a_values, targets.data(), 0, desc.width);
+}
+
+void method_sweep(const RenderDesc &desc, const std::vector<complex> &a_values, char *const *draws,
+                  int x_begin, int x_end){
+    double fraction_x = (desc.c4.first - desc.c1.first) / desc.width;
+    double fraction_y = (desc.c1.second - desc.c4.second) / desc.height;
+    Lanes lanes;
+    for (std::size_t first = 0; first < a_values.size(); first += LANES){
+        load_parameters(lanes, a_values, first);
+        std::size_t count = std::min<std::size_t>(LANES, a_values.size() - first);
+        for (int x = x_begin; x < x_end; ++x){
+            for (int y = 0; y < desc.height; ++y){
+                for (int k = 0; k < LANES; ++k){
+                    lanes.zr[k] = desc.c1.first + fraction_x * (0.5 + x);
+                    lanes.zi[k] = desc.c4.second + fraction_y * (0.5 + y);
+                }
+                iterate(lanes, desc.roots, desc.number_of_iterations);
+                for (std::size_t k = 0; k < count; ++k){
+                    draws[first + k][x * desc.height + y] =
+                        Newton::find_closest_root(desc.roots, complex(lanes.zr[k], lanes.zi[k])).second;
+                }
+            }
+        }
+    }
+}
+
+std::vector<complex> parameter_grid(std::pair<double, double> c1, std::pair<double, double> c4,
+                                    int columns, int rows){
+    std::vector<complex> a_values;
+    double fraction_x = (c4.first - c1.first) / columns;
+    double fraction_y = (c1.second - c4.second) / rows;
+    for (int x = 0; x < columns; ++x){
+        for (int y = 0; y < rows; ++y){
+            a_values.push_back(complex(c1.first + fraction_x * (0.5 + x), c4.second + fraction_y * (0.5 + y)));
+        }
+    }
+    return a_values;
+}
+
+void parameter_plane(const RenderDesc &desc, complex seed, std::vector<char> &draw){
+    draw.resize(desc.width * desc.height);
+    parameter_plane(desc, seed, draw.data(), 0, desc.width);
+}
+
+void parameter_plane(const RenderDesc &desc, complex seed, char *draw, int x_begin, int x_end){
+    if (x_begin >= x_end || desc.height <= 0){
+        return;
+    }
+    RenderDesc columns = desc.region(x_begin, 0, x_end - x_begin, desc.height);
+    std::vector<complex> a_values = parameter_grid(columns.c1, columns.c4, columns.width, columns.height);
+    double converged = 1e-6 * Newton::root_scale(desc.roots);
+    draw += x_begin * desc.height;
+    Lanes lanes;
+    for (std::size_t first = 0; first < a_values.size(); first += LANES){
+        load_parameters(lanes, a_values, first);
+        for (int k = 0; k < LANES; ++k){
+            lanes.zr[k] = seed.real();
+            lanes.zi[k] = seed.imag();
+        }
+        iterate(lanes, desc.roots, desc.number_of_iterations);
+        std::size_t count = std::min<std::size_t>(LANES, a_values.size() - first);
+        for (std::size_t k = 0; k < count; ++k){
+            complex z(lanes.zr[k], lanes.zi[k]);
+            std::pair<complex, char> root = Newton::find_closest_root(desc.roots, z);
+            draw[first + k] = std::abs(z - root.first) < converged ? root.second : char(Newton::NO_ROOT);
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef parameter_sweep
+#define parameter_sweep
+#include <vector>
+#include "Newton.cpp"
+
+// Relaxed Newton over many values of the parameter a at once. Each pixel is
+// iterated for a whole group of a values in lock step, so the inner loops run
+// over independent lanes and the root data is read once per group.
+
+// draws[k] receives the frame of desc rendered with a = a_values[k], laid out
+// like the output of Newton::method. desc.a is ignored.
+void method_sweep(const RenderDesc &desc, const std::vector<complex> &a_values,
+                  std::vector<std::vector<char> > &draws);
+// The columns [x_begin, x_end) of the same frames; draws[k] holds the whole
+// frame for a_values[k].
+void method_sweep(const RenderDesc &desc, const std::vector<complex> &a_values, char *const *draws,
+                  int x_begin, int x_end);
+
+// Parameter plane: the viewport of desc spans values of a instead of starting
+// points. Every a is iterated from seed and coloured by the root it converges
+// to, or Newton::NO_ROOT if it does not settle within the iteration limit.
+void parameter_plane(const RenderDesc &desc, complex seed, std::vector<char> &draw);
+// The columns [x_begin, x_end) of the parameter plane, so stripes can be
+// rendered in parallel; draw holds the whole frame.
+void parameter_plane(const RenderDesc &desc, complex seed, char *draw, int x_begin, int x_end);
+
+// Values of a at the pixel centres of a columns x rows grid over [c1, c4],
+// in the same order as the pixels of Newton::method.
+std::vector<complex> parameter_grid(std::pair<double, double> c1, std::pair<double, double> c4,
+                                    int columns, int rows);
+#endif
@@ -0,0 +1,559 @@
+#include "Remote.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace{
+enum MessageType {VIEW = 1, ROOTS, ITERATIONS, FRAME};
+enum FrameKind {KEY, DELTA};
+const int HEADER = 5;
+const std::uint32_t MAX_PAYLOAD = 1u << 28;
+// Largest frame (in pixels) and iteration count a server accepts; a client
+// asking for more is disconnected.
+const long long MAX_PIXELS = 1ll << 26;
+const int MAX_ITERATIONS = 1 << 20;
+
+// Appends messages to one buffer, so a burst of commands goes out in one write.
+struct Writer{
+    std::vector<unsigned char> bytes;
+    std::size_t start;
+    Writer(): start(0){}
+    void begin(MessageType type){
+        start = bytes.size();
+        bytes.push_back(type);
+        bytes.resize(bytes.size() + 4);
+    }
+    void end(){
+        std::uint32_t length = bytes.size() - start - HEADER;
+        for (int i = 0; i < 4; ++i){
+            bytes[start + 1 + i] = (length >> (8 * i)) & 0xff;
+        }
+    }
+    void u8(unsigned value){
+        bytes.push_back(value & 0xff);
+    }
+    void u32(std::uint32_t value){
+        for (int i = 0; i < 4; ++i){
+            bytes.push_back((value >> (8 * i)) & 0xff);
+        }
+    }
+    void i32(int value){
+        u32(static_cast<std::uint32_t>(value));
+    }
+    void f64(double value){
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (int i = 0; i < 8; ++i){
+            bytes.push_back((bits >> (8 * i)) & 0xff);
+        }
+    }
+};
+// Reads a payload; any read past its end clears ok.
+struct Reader{
+    std::vector<unsigned char> const &bytes;
+    std::size_t pos;
+    bool ok;
+    Reader(std::vector<unsigned char> const &bytes): bytes(bytes), pos(0), ok(true){}
+    bool take(std::size_t count){
+        ok = ok && pos + count <= bytes.size();
+        return ok;
+    }
+    unsigned u8(){
+        return take(1) ? bytes[pos++] : 0;
+    }
+    std::uint32_t u32(){
+        std::uint32_t value = 0;
+        for (int i = 0; i < 4 && take(1); ++i){
+            value |= std::uint32_t(bytes[pos++]) << (8 * i);
+        }
+        return value;
+    }
+    int i32(){
+        return static_cast<std::int32_t>(u32());
+    }
+    double f64(){
+        std::uint64_t bits = 0;
+        for (int i = 0; i < 8 && take(1); ++i){
+            bits |= std::uint64_t(bytes[pos++]) << (8 * i);
+        }
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+};
+
+bool send_all(int socket, std::vector<unsigned char> const &bytes){
+    std::size_t sent = 0;
+    while (sent < bytes.size()){
+        ssize_t count = send(socket, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR){
+            continue;
+        }
+        if (count <= 0){
+            return false;
+        }
+        sent += count;
+    }
+    return true;
+}
+bool receive_all(int socket, unsigned char *data, std::size_t size){
+    while (size > 0){
+        ssize_t count = recv(socket, data, size, 0);
+        if (count < 0 && errno == EINTR){
+            continue;
+        }
+        if (count <= 0){
+            return false;
+        }
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+bool receive_message(int socket, unsigned &type, std::vector<unsigned char> &payload){
+    unsigned char header[HEADER];
+    if (!receive_all(socket, header, HEADER)){
+        return false;
+    }
+    std::uint32_t length = 0;
+    for (int i = 0; i < 4; ++i){
+        length |= std::uint32_t(header[1 + i]) << (8 * i);
+    }
+    if (length > MAX_PAYLOAD){
+        return false;
+    }
+    type = header[0];
+    payload.resize(length);
+    return receive_all(socket, payload.data(), length);
+}
+void set_no_delay(int socket){
+    int on = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+std::size_t plane_size(long long count, int bits){
+    return (count * bits + 7) / 8;
+}
+}
+
+int plane_bits(std::vector<char> const &draw){
+    for (auto it = draw.begin(); it != draw.end(); ++it){
+        if (static_cast<unsigned char>(*it + 1) > 15){
+            return 8;
+        }
+    }
+    return 4;
+}
+void pack_plane(std::vector<char> const &draw, int bits, std::vector<unsigned char> &plane){
+    plane.assign(plane_size(draw.size(), bits), 0);
+    for (std::size_t i = 0; i < draw.size(); ++i){
+        unsigned char symbol = draw[i] + 1;
+        if (bits == 8){
+            plane[i] = symbol;
+        }
+        else{
+            plane[i / 2] |= symbol << (4 * (i % 2));
+        }
+    }
+}
+void unpack_plane(std::vector<unsigned char> const &plane, int bits, int count, std::vector<char> &draw){
+    draw.resize(count);
+    for (int i = 0; i < count; ++i){
+        unsigned char symbol = bits == 8 ? plane[i] : (plane[i / 2] >> (4 * (i % 2))) & 0xf;
+        draw[i] = static_cast<char>(symbol - 1);
+    }
+}
+// PackBits: a header byte h < 128 is followed by h + 1 literal bytes, h > 128
+// by one byte that repeats 257 - h times.
+void packbits_compress(std::vector<unsigned char> const &src, std::vector<unsigned char> &out){
+    out.clear();
+    std::size_t i = 0, n = src.size();
+    while (i < n){
+        std::size_t j = i + 1;
+        while (j < n && j - i < 128 && src[j] == src[i]){
+            ++j;
+        }
+        if (j - i >= 3){
+            out.push_back(257 - (j - i));
+            out.push_back(src[i]);
+            i = j;
+            continue;
+        }
+        j = i;
+        while (j < n && j - i < 128 && !(j + 2 < n && src[j] == src[j + 1] && src[j] == src[j + 2])){
+            ++j;
+        }
+        out.push_back(j - i - 1);
+        out.insert(out.end(), src.begin() + i, src.begin() + j);
+        i = j;
+    }
+}
+bool packbits_expand(unsigned char const *src, std::size_t length, std::size_t size, std::vector<unsigned char> &out){
+    out.clear();
+    out.reserve(size);
+    std::size_t i = 0;
+    while (i < length){
+        unsigned header = src[i++];
+        if (header < 128){
+            if (i + header + 1 > length || out.size() + header + 1 > size){
+                return false;
+            }
+            out.insert(out.end(), src + i, src + i + header + 1);
+            i += header + 1;
+        }
+        else if (header > 128){
+            if (i >= length || out.size() + 257 - header > size){
+                return false;
+            }
+            out.insert(out.end(), 257 - header, src[i++]);
+        }
+    }
+    return out.size() == size;
+}
+
+RenderServer::RenderServer(unsigned short port, unsigned threads):
+    service(threads), listener(socket(AF_INET, SOCK_STREAM, 0)), port(0), stopping(false){
+    if (listener < 0){
+        return;
+    }
+    int on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    socklen_t length = sizeof(address);
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 8) != 0 ||
+        getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length) != 0){
+        close(listener);
+        listener = -1;
+        return;
+    }
+    this->port = ntohs(address.sin_port);
+}
+RenderServer::operator bool() const{
+    return listener >= 0;
+}
+unsigned short RenderServer::get_port() const{
+    return port;
+}
+void RenderServer::serve(){
+    while (listener >= 0){
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0 && errno == EINTR){
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        if (client < 0 || stopping){
+            if (client >= 0){
+                close(client);
+            }
+            break;
+        }
+        reap();
+        set_no_delay(client);
+        clients.push_back(client);
+        connections.push_back(std::thread(&RenderServer::serve_connection, this, client));
+    }
+    for (auto it = connections.begin(); it != connections.end(); ++it){
+        it->join();
+    }
+    connections.clear();
+    finished.clear();
+}
+// Joins the threads of sessions that have ended; the lock must be held.
+void RenderServer::reap(){
+    for (auto id = finished.begin(); id != finished.end(); ++id){
+        for (auto it = connections.begin(); it != connections.end(); ++it){
+            if (it->get_id() == *id){
+                it->join();
+                connections.erase(it);
+                break;
+            }
+        }
+    }
+    finished.clear();
+}
+void RenderServer::stop(){
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+    if (listener >= 0){
+        shutdown(listener, SHUT_RDWR);
+    }
+    for (auto it = clients.begin(); it != clients.end(); ++it){
+        shutdown(*it, SHUT_RDWR);
+    }
+}
+// Every connection is a session of its own: the current frame description and
+// the last plane sent for each view id, which deltas are taken against.
+void RenderServer::serve_connection(int client){
+    RenderDesc desc;
+    desc.width = desc.height = 0;
+    desc.number_of_iterations = 0;
+    desc.c1 = desc.c4 = std::make_pair(0.0, 0.0);
+    desc.a = complex(1, 0);
+    std::map<int, std::pair<int, std::vector<unsigned char> > > previous;
+    std::vector<unsigned char> payload, plane, delta;
+    unsigned type;
+    while (receive_message(client, type, payload)){
+        Reader in(payload);
+        if (type == VIEW){
+            desc.c1.first = in.f64();
+            desc.c1.second = in.f64();
+            desc.c4.first = in.f64();
+            desc.c4.second = in.f64();
+            desc.width = in.i32();
+            desc.height = in.i32();
+            if (!in.ok || desc.width < 0 || desc.height < 0 || static_cast<long long>(desc.width) * desc.height > MAX_PIXELS){
+                break;
+            }
+            continue;
+        }
+        if (type == ROOTS){
+            desc.roots.resize(in.u8());
+            for (auto it = desc.roots.begin(); it != desc.roots.end(); ++it){
+                double re = in.f64();
+                it->first = complex(re, in.f64());
+                it->second = static_cast<char>(in.u8());
+            }
+        }
+        else if (type == ITERATIONS){
+            desc.number_of_iterations = in.i32();
+            double re = in.f64();
+            desc.a = complex(re, in.f64());
+            desc.certify_tiles = in.u8() != 0;
+            in.ok = in.ok && desc.number_of_iterations >= 0 && desc.number_of_iterations <= MAX_ITERATIONS;
+        }
+        if (!in.ok || (type != ROOTS && type != ITERATIONS && type != FRAME)){
+            break;
+        }
+        if (type != FRAME){
+            continue;
+        }
+        std::uint32_t id = in.u32();
+        int view = in.i32();
+        if (!in.ok){
+            break;
+        }
+        Frame frame = service.submit(desc).get();
+        int bits = plane_bits(*frame);
+        pack_plane(*frame, bits, plane);
+        auto last = previous.find(view);
+        FrameKind kind = view >= 0 && last != previous.end() && last->second.first == bits &&
+                         last->second.second.size() == plane.size() ? DELTA : KEY;
+        if (kind == DELTA){
+            delta.resize(plane.size());
+            for (std::size_t i = 0; i < plane.size(); ++i){
+                delta[i] = plane[i] ^ last->second.second[i];
+            }
+        }
+        Writer out;
+        out.begin(FRAME);
+        out.u32(id);
+        out.i32(view);
+        out.u8(kind);
+        out.u8(bits);
+        std::vector<unsigned char> compressed;
+        packbits_compress(kind == DELTA ? delta : plane, compressed);
+        out.bytes.insert(out.bytes.end(), compressed.begin(), compressed.end());
+        out.end();
+        if (!send_all(client, out.bytes)){
+            break;
+        }
+        if (view >= 0){
+            previous[view] = std::make_pair(bits, plane);
+        }
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    clients.remove(client);
+    close(client);
+    finished.push_back(std::this_thread::get_id());
+}
+RenderServer::~RenderServer(){
+    stop();
+    for (auto it = connections.begin(); it != connections.end(); ++it){
+        it->join();
+    }
+    if (listener >= 0){
+        close(listener);
+    }
+}
+
+RemoteClient::RemoteClient(std::string const &host, unsigned short port):
+    server(-1), stopping(false), synced(false), next_id(0), bytes_received(0){
+    addrinfo hints, *addresses = nullptr;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) == 0){
+        for (addrinfo *it = addresses; it && server < 0; it = it->ai_next){
+            server = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+            if (server >= 0 && connect(server, it->ai_addr, it->ai_addrlen) != 0){
+                close(server);
+                server = -1;
+            }
+        }
+        freeaddrinfo(addresses);
+    }
+    if (server < 0){
+        error = "cannot connect to " + host + ":" + std::to_string(port);
+    }
+    else{
+        set_no_delay(server);
+    }
+    worker = std::thread(&RemoteClient::work, this);
+}
+RemoteClient::operator bool(){
+    std::lock_guard<std::mutex> guard(lock);
+    return error.empty();
+}
+std::string RemoteClient::get_error(){
+    std::lock_guard<std::mutex> guard(lock);
+    return error;
+}
+long long RemoteClient::get_bytes_received(){
+    std::lock_guard<std::mutex> guard(lock);
+    return bytes_received;
+}
+std::shared_future<Frame> RemoteClient::submit(RenderDesc const &desc, int view){
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto it = queue.begin(); it != queue.end(); ++it){
+        if ((*it)->view == view && ((*it)->desc == desc || view >= 0)){
+            (*it)->desc = desc;
+            return (*it)->result;
+        }
+    }
+    std::shared_ptr<Request> request(new Request());
+    request->desc = desc;
+    request->view = view;
+    request->result = request->promise.get_future().share();
+    queue.push_back(request);
+    wake.notify_one();
+    return request->result;
+}
+void RemoteClient::work(){
+    std::unique_lock<std::mutex> guard(lock);
+    while (true){
+        wake.wait(guard, [this]{
+            return stopping || !queue.empty();
+        });
+        if (queue.empty()){
+            return;
+        }
+        std::shared_ptr<Request> request = queue.front();
+        queue.pop_front();
+        guard.unlock();
+        std::shared_ptr<std::vector<char> > draw(new std::vector<char>());
+        bool received = server >= 0 && round_trip(*request, *draw);
+        if (!received){
+            draw->assign(std::max(request->desc.width, 0) * std::max(request->desc.height, 0), Newton::NO_ROOT);
+        }
+        guard.lock();
+        if (!received && server >= 0){
+            error = "connection to the render server lost";
+            close(server);
+            server = -1;
+        }
+        request->promise.set_value(draw);
+    }
+}
+// Sends the commands that bring the server's session to request.desc, then
+// waits for the frame and decodes it into draw.
+bool RemoteClient::round_trip(Request &request, std::vector<char> &draw){
+    RenderDesc const &desc = request.desc;
+    Writer out;
+    if (!synced || desc.c1 != sent.c1 || desc.c4 != sent.c4 || desc.width != sent.width || desc.height != sent.height){
+        out.begin(VIEW);
+        out.f64(desc.c1.first);
+        out.f64(desc.c1.second);
+        out.f64(desc.c4.first);
+        out.f64(desc.c4.second);
+        out.i32(desc.width);
+        out.i32(desc.height);
+        out.end();
+    }
+    if (!synced || desc.roots != sent.roots){
+        if (desc.roots.size() > 255){
+            return false;
+        }
+        out.begin(ROOTS);
+        out.u8(desc.roots.size());
+        for (auto it = desc.roots.begin(); it != desc.roots.end(); ++it){
+            out.f64(it->first.real());
+            out.f64(it->first.imag());
+            out.u8(static_cast<unsigned char>(it->second));
+        }
+        out.end();
+    }
+    if (!synced || desc.number_of_iterations != sent.number_of_iterations || desc.a != sent.a ||
+        desc.certify_tiles != sent.certify_tiles){
+        out.begin(ITERATIONS);
+        out.i32(desc.number_of_iterations);
+        out.f64(desc.a.real());
+        out.f64(desc.a.imag());
+        out.u8(desc.certify_tiles);
+        out.end();
+    }
+    std::uint32_t id = next_id++;
+    out.begin(FRAME);
+    out.u32(id);
+    out.i32(request.view);
+    out.end();
+    if (!send_all(server, out.bytes)){
+        return false;
+    }
+    sent = desc;
+    synced = true;
+
+    unsigned type;
+    std::vector<unsigned char> payload;
+    if (!receive_message(server, type, payload) || type != FRAME){
+        return false;
+    }
+    Reader in(payload);
+    std::uint32_t reply_id = in.u32();
+    int view = in.i32();
+    unsigned kind = in.u8();
+    int bits = in.u8();
+    if (!in.ok || reply_id != id || view != request.view || kind > DELTA || (bits != 4 && bits != 8)){
+        return false;
+    }
+    long long count = static_cast<long long>(std::max(desc.width, 0)) * std::max(desc.height, 0);
+    std::vector<unsigned char> plane;
+    if (!packbits_expand(payload.data() + in.pos, payload.size() - in.pos, plane_size(count, bits), plane)){
+        return false;
+    }
+    if (kind == DELTA){
+        auto last = previous.find(view);
+        if (last == previous.end() || last->second.bits != bits || last->second.bytes.size() != plane.size()){
+            return false;
+        }
+        for (std::size_t i = 0; i < plane.size(); ++i){
+            plane[i] ^= last->second.bytes[i];
+        }
+    }
+    unpack_plane(plane, bits, count, draw);
+    if (view >= 0){
+        previous[view] = Plane{bits, plane};
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    bytes_received += payload.size() + HEADER;
+    return true;
+}
+RemoteClient::~RemoteClient(){
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+    if (server >= 0){
+        close(server);
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef remote_protocol
+#define remote_protocol
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Newton.cpp"
+#include "RenderService.h"
+
+// Render server and thin client talking over TCP.
+//
+// The client keeps the server's copy of the view, the roots and the iteration
+// settings up to date with VIEW, ROOTS and ITERATIONS commands, sending only
+// those that changed, and asks for a frame with FRAME. Every message is a type
+// byte and a 32-bit payload length followed by the payload; all numbers are
+// little-endian and doubles travel as their exact bit patterns, so both ends
+// agree on every pixel centre.
+//
+// Frames come back as root-index planes: pixel colour + 1 (so NO_ROOT is 0)
+// packed into 4 bits when every value fits, otherwise 8. For a view id that
+// was rendered before with the same size, the plane is XOR-ed with the
+// previous one, so unchanged pixels become zero bytes, and the result is
+// run-length coded with PackBits.
+
+// Bits per pixel of the packed plane of draw: 4 or 8.
+int plane_bits(std::vector<char> const &draw);
+void pack_plane(std::vector<char> const &draw, int bits, std::vector<unsigned char> &plane);
+void unpack_plane(std::vector<unsigned char> const &plane, int bits, int count, std::vector<char> &draw);
+void packbits_compress(std::vector<unsigned char> const &src, std::vector<unsigned char> &out);
+// Expands src, which must decode to exactly size bytes.
+bool packbits_expand(unsigned char const *src, std::size_t length, std::size_t size, std::vector<unsigned char> &out);
+
+class RenderServer{
+    RenderService service;
+    int listener;
+    unsigned short port;
+    std::mutex lock;
+    std::list<int> clients;
+    std::list<std::thread> connections;
+    std::vector<std::thread::id> finished;
+    bool stopping;
+    void serve_connection(int client);
+    void reap();
+public:
+    // Listens on port of every interface; port 0 picks a free one.
+    RenderServer(unsigned short port, unsigned threads = 0);
+    RenderServer(RenderServer const &src) = delete;
+    RenderServer(RenderServer &&src) = delete;
+    RenderServer& operator=(RenderServer const &rhs) = delete;
+    RenderServer& operator=(RenderServer &&rhs) = delete;
+    operator bool() const;
+    unsigned short get_port() const;
+    // Accepts and serves clients until stop() is called.
+    void serve();
+    void stop();
+    ~RenderServer();
+};
+
+// Drop-in for RenderService::submit that renders on a RenderServer. Requests
+// are sent one at a time; a queued request for a view is replaced by a newer
+// one like in RenderService. If the connection fails, frames come back with
+// every pixel NO_ROOT and get_error() tells why.
+class RemoteClient{
+    struct Request{
+        RenderDesc desc;
+        int view;
+        std::promise<Frame> promise;
+        std::shared_future<Frame> result;
+    };
+    struct Plane{
+        int bits;
+        std::vector<unsigned char> bytes;
+    };
+    int server;
+    std::thread worker;
+    std::deque<std::shared_ptr<Request> > queue;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping;
+    std::string error;
+    bool synced;
+    RenderDesc sent;
+    std::map<int, Plane> previous;
+    unsigned next_id;
+    long long bytes_received;
+    void work();
+    bool round_trip(Request &request, std::vector<char> &draw);
+public:
+    RemoteClient(std::string const &host, unsigned short port);
+    RemoteClient(RemoteClient const &src) = delete;
+    RemoteClient(RemoteClient &&src) = delete;
+    RemoteClient& operator=(RemoteClient const &rhs) = delete;
+    RemoteClient& operator=(RemoteClient &&rhs) = delete;
+    operator bool();
+    std::string get_error();
+    std::shared_future<Frame> submit(RenderDesc const &desc, int view = -1);
+    // Payload bytes of all frames received so far.
+    long long get_bytes_received();
+    ~RemoteClient();
+};
+#endif
@@ -0,0 +1,133 @@
+#include "RenderService.h"
+#include <algorithm>
+
+RenderService::RenderService(unsigned threads, int stripe): stopping(false), stripe(std::max(stripe, 1)){
+    if (threads == 0){
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    for (unsigned i = 0; i < threads; ++i){
+        workers.push_back(std::thread(&RenderService::work, this));
+    }
+}
+void RenderService::enqueue(std::shared_ptr<Job> job, Priority priority){
+    job->priority = priority;
+    queues[priority].push_back(job);
+}
+std::shared_future<Frame> RenderService::submit(RenderDesc const &desc, Priority priority, int view,
+                                                std::shared_ptr<std::vector<char> > buffer){
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto it = jobs.begin(); it != jobs.end() && !buffer; ++it){
+        std::shared_ptr<Job> job = *it;
+        if (job->exclusive){
+            continue;
+        }
+        bool pending = job->next_column == 0;
+        bool superseded = pending && view >= 0 && job->view == view;
+        if (job->desc != desc && !superseded){
+            continue;
+        }
+        if (superseded){
+            job->desc = desc;
+        }
+        if (pending && priority < job->priority){
+            auto &queue = queues[job->priority];
+            queue.erase(std::find(queue.begin(), queue.end(), job));
+            enqueue(job, priority);
+        }
+        return job->result;
+    }
+    return add(desc, priority, view, buffer, nullptr);
+}
+std::shared_future<Frame> RenderService::submit_columns(int width, int height, Columns columns, Priority priority,
+                                                        std::shared_ptr<std::vector<char> > buffer){
+    RenderDesc desc;
+    desc.width = width;
+    desc.height = height;
+    std::lock_guard<std::mutex> guard(lock);
+    return add(desc, priority, -1, buffer, columns);
+}
+// Queues a new job; the lock must be held.
+std::shared_future<Frame> RenderService::add(RenderDesc const &desc, Priority priority, int view,
+                                             std::shared_ptr<std::vector<char> > buffer, Columns columns){
+    std::shared_ptr<Job> job(new Job());
+    job->desc = desc;
+    job->view = view;
+    job->result = job->promise.get_future().share();
+    job->next_column = 0;
+    job->done_columns = 0;
+    job->draw = buffer;
+    job->columns = columns;
+    job->exclusive = buffer || columns;
+    if (desc.width <= 0 || desc.height <= 0){
+        if (buffer){
+            buffer->clear();
+        }
+        job->promise.set_value(buffer ? buffer : Frame(new std::vector<char>()));
+        return job->result;
+    }
+    jobs.push_back(job);
+    enqueue(job, priority);
+    wake.notify_all();
+    return job->result;
+}
+void RenderService::work(){
+    std::unique_lock<std::mutex> guard(lock);
+    while (true){
+        wake.wait(guard, [this]{
+            return stopping || !queues[INTERACTIVE].empty() || !queues[BATCH].empty();
+        });
+        auto &queue = queues[INTERACTIVE].empty() ? queues[BATCH] : queues[INTERACTIVE];
+        if (queue.empty()){
+            return;
+        }
+        std::shared_ptr<Job> job = queue.front();
+        if (job->next_column == 0){
+            if (job->draw){
+                job->draw->resize(job->desc.width * job->desc.height);
+            }
+            else{
+                job->draw.reset(new std::vector<char>(job->desc.width * job->desc.height));
+            }
+            if (!job->columns){
+                job->symmetry.reset(new Symmetry(job->desc));
+            }
+        }
+        int begin = job->next_column;
+        int end = std::min(begin + stripe, job->desc.width);
+        job->next_column = end;
+        if (end == job->desc.width){
+            queue.pop_front();
+        }
+        guard.unlock();
+        if (job->columns){
+            job->columns(job->draw->data(), begin, end);
+        }
+        else{
+            job->symmetry->render_columns(job->desc, job->draw->data(), begin, end);
+        }
+        guard.lock();
+        job->done_columns += end - begin;
+        if (job->done_columns == job->desc.width){
+            guard.unlock();
+            if (job->symmetry){
+                job->symmetry->fill(job->desc, job->draw->data());
+            }
+            guard.lock();
+            jobs.remove(job);
+            job->promise.set_value(job->draw);
+        }
+    }
+}
+unsigned RenderService::get_threads(){
+    return workers.size();
+}
+RenderService::~RenderService(){
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto it = workers.begin(); it != workers.end(); ++it){
+        it->join();
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef render_service
+#define render_service
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Newton.cpp"
+#include "Symmetry.h"
+
+using Frame = std::shared_ptr<const std::vector<char> >;
+
+// Thread pool that renders RenderDesc frames and hands them out as futures.
+// Interactive requests are served before batch ones at stripe granularity,
+// an exact duplicate of an unfinished request shares its future, and a request
+// for a view that still has a not-yet-started request replaces it: everyone
+// waiting on the superseded request receives the newer frame. Symmetric root
+// sets are rendered through Symmetry, so only a fundamental region is iterated.
+// A caller that recycles frame memory may pass its own buffer to render into;
+// such requests are never merged with others, so the buffer is only shared
+// with the caller. Other column renderers can use the pool through
+// submit_columns.
+class RenderService{
+public:
+    enum Priority {INTERACTIVE, BATCH};
+    // Renders the columns [x_begin, x_end) of a frame into draw.
+    using Columns = std::function<void(char *draw, int x_begin, int x_end)>;
+private:
+    struct Job{
+        RenderDesc desc;
+        Priority priority;
+        int view;
+        std::promise<Frame> promise;
+        std::shared_future<Frame> result;
+        std::shared_ptr<std::vector<char> > draw;
+        bool exclusive;
+        std::shared_ptr<Symmetry> symmetry;
+        Columns columns;
+        int next_column;
+        int done_columns;
+    };
+    std::vector<std::thread> workers;
+    std::array<std::deque<std::shared_ptr<Job> >, 2> queues;
+    std::list<std::shared_ptr<Job> > jobs;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping;
+    int stripe;
+    void work();
+    void enqueue(std::shared_ptr<Job> job, Priority priority);
+    std::shared_future<Frame> add(RenderDesc const &desc, Priority priority, int view,
+                                  std::shared_ptr<std::vector<char> > buffer, Columns columns);
+public:
+    RenderService(unsigned threads = 0, int stripe = 16);
+    RenderService(RenderService const &src) = delete;
+    RenderService(RenderService &&src) = delete;
+    RenderService& operator=(RenderService const &rhs) = delete;
+    RenderService& operator=(RenderService &&rhs) = delete;
+    std::shared_future<Frame> submit(RenderDesc const &desc, Priority priority = INTERACTIVE, int view = -1,
+                                     std::shared_ptr<std::vector<char> > buffer = nullptr);
+    // A width x height frame rendered by columns instead of the Newton engine.
+    // Such requests are never merged with others.
+    std::shared_future<Frame> submit_columns(int width, int height, Columns columns, Priority priority = BATCH,
+                                             std::shared_ptr<std::vector<char> > buffer = nullptr);
+    unsigned get_threads();
+    ~RenderService();
+};
+#endif
@@ -0,0 +1,167 @@
+#include "Symmetry.h"
+#include <cmath>
+
+namespace{
+const double PI = 3.14159265358979323846;
+// An isometry is only used when it maps pixel centres to pixel centres up to
+// this fraction of a pixel, so copied pixels match a full render.
+const double ALIGNMENT = 1e-3;
+
+double pixel_x(const RenderDesc &desc, complex z){
+    return (z.real() - desc.c1.first) / (desc.c4.first - desc.c1.first) * desc.width - 0.5;
+}
+double pixel_y(const RenderDesc &desc, complex z){
+    return (z.imag() - desc.c4.second) / (desc.c1.second - desc.c4.second) * desc.height - 0.5;
+}
+complex pixel_centre(const RenderDesc &desc, double x, double y){
+    double fraction_x = (desc.c4.first - desc.c1.first) / desc.width;
+    double fraction_y = (desc.c1.second - desc.c4.second) / desc.height;
+    return complex(desc.c1.first + fraction_x * (0.5 + x), desc.c4.second + fraction_y * (0.5 + y));
+}
+}
+
+Symmetry::Symmetry(const RenderDesc &desc): centre(0, 0), order(1), mirrored(false), roots(desc.roots),
+                                             certifier(desc){
+    root_of_color.fill(-1);
+    tolerance = 1e-9 * Newton::root_scale(roots);
+    if (roots.empty() || desc.width <= 0 || desc.height <= 0){
+        return;
+    }
+    for (auto it = roots.begin(); it != roots.end(); ++it){
+        centre += it->first;
+    }
+    centre /= static_cast<double>(roots.size());
+    for (std::size_t i = 0; i < roots.size(); ++i){
+        for (std::size_t j = i + 1; j < roots.size(); ++j){
+            if (std::abs(roots[i].first - roots[j].first) < tolerance){
+                return;
+            }
+        }
+    }
+    for (int n = roots.size(); n >= 2; --n){
+        if (is_invariant(Isometry({std::polar(1.0, 2 * PI / n), false}))){
+            order = n;
+            break;
+        }
+    }
+    complex axis(1, 0);
+    if (desc.a.imag() == 0){
+        for (int k = 0; k < 2 && !mirrored; ++k){
+            axis = std::polar(1.0, k * PI);
+            mirrored = is_invariant(Isometry({axis, true}));
+        }
+    }
+    for (int k = 0; k < order; ++k){
+        for (int reflect = 0; reflect < (mirrored ? 2 : 1); ++reflect){
+            Isometry element({std::polar(1.0, 2 * PI * k / order) * (reflect ? axis : complex(1, 0)), reflect == 1});
+            if ((k == 0 && reflect == 0) || !is_aligned(desc, element)){
+                continue;
+            }
+            std::vector<char> permutation;
+            for (auto it = roots.begin(); it != roots.end(); ++it){
+                int image = find_root(inverse(element, it->first));
+                if (image >= 0){
+                    image = Newton::cluster_representative(roots, image, Newton::coincidence_tolerance(roots));
+                }
+                permutation.push_back(image < 0 ? char(Newton::NO_ROOT) : roots[image].second);
+            }
+            elements.push_back(element);
+            colors.push_back(permutation);
+        }
+    }
+    for (int i = roots.size() - 1; i >= 0; --i){
+        root_of_color[static_cast<unsigned char>(roots[i].second)] = i;
+    }
+}
+int Symmetry::find_root(complex p) const{
+    for (std::size_t i = 0; i < roots.size(); ++i){
+        if (std::abs(roots[i].first - p) < tolerance){
+            return i;
+        }
+    }
+    return -1;
+}
+bool Symmetry::is_invariant(Isometry const &element) const{
+    for (auto it = roots.begin(); it != roots.end(); ++it){
+        if (find_root(apply(element, it->first)) < 0){
+            return false;
+        }
+    }
+    return true;
+}
+// The isometry is real affine, so it maps the whole pixel lattice onto itself
+// when it does so for the centres of three neighbouring pixels.
+bool Symmetry::is_aligned(const RenderDesc &desc, Isometry const &element) const{
+    const double probes[3][2] = {{0, 0}, {1, 0}, {0, 1}};
+    for (int i = 0; i < 3; ++i){
+        complex image = apply(element, pixel_centre(desc, probes[i][0], probes[i][1]));
+        double x = pixel_x(desc, image), y = pixel_y(desc, image);
+        if (std::abs(x - std::round(x)) > ALIGNMENT || std::abs(y - std::round(y)) > ALIGNMENT){
+            return false;
+        }
+    }
+    return true;
+}
+complex Symmetry::apply(Isometry const &element, complex z) const{
+    complex w = z - centre;
+    return centre + element.turn * (element.reflect ? std::conj(w) : w);
+}
+complex Symmetry::inverse(Isometry const &element, complex z) const{
+    complex w = (z - centre) / element.turn;
+    return centre + (element.reflect ? std::conj(w) : w);
+}
+// A pixel is copied from the first pixel of its orbit, in memory order.
+bool Symmetry::source(const RenderDesc &desc, int x, int y, int &element, int &cell) const{
+    complex z = pixel_centre(desc, x, y);
+    cell = x * desc.height + y;
+    element = -1;
+    for (std::size_t i = 0; i < elements.size(); ++i){
+        complex image = apply(elements[i], z);
+        int image_x = std::lround(pixel_x(desc, image));
+        int image_y = std::lround(pixel_y(desc, image));
+        if (image_x < 0 || image_x >= desc.width || image_y < 0 || image_y >= desc.height){
+            continue;
+        }
+        if (image_x * desc.height + image_y < cell){
+            cell = image_x * desc.height + image_y;
+            element = i;
+        }
+    }
+    return element >= 0;
+}
+int Symmetry::group_size() const{
+    return order * (mirrored ? 2 : 1);
+}
+void Symmetry::render_columns(const RenderDesc &desc, char *draw, int x_begin, int x_end) const{
+    double scale = Newton::root_scale(desc.roots);
+    std::vector<RootCluster> clusters = Newton::find_clusters(desc.roots);
+    int element, cell;
+    if (desc.certify_tiles){
+        certifier.render_columns(desc, draw, x_begin, x_end);
+    }
+    for (int x = x_begin; x < x_end; ++x){
+        for (int y = 0; y < desc.height; ++y){
+            if (desc.certify_tiles && draw[x * desc.height + y] != Newton::PENDING){
+                continue;
+            }
+            if (source(desc, x, y, element, cell)){
+                draw[x * desc.height + y] = Newton::PENDING;
+            }else{
+                draw[x * desc.height + y] = Newton::calculate_pixel(desc, pixel_centre(desc, x, y), scale, clusters);
+            }
+        }
+    }
+}
+void Symmetry::fill(const RenderDesc &desc, char *draw) const{
+    int element, cell;
+    for (int x = 0; x < desc.width; ++x){
+        for (int y = 0; y < desc.height; ++y){
+            if (draw[x * desc.height + y] != Newton::PENDING || !source(desc, x, y, element, cell)){
+                continue;
+            }
+            char color = draw[cell];
+            int root = root_of_color[static_cast<unsigned char>(color)];
+            draw[x * desc.height + y] = color == Newton::NO_ROOT || root < 0 ? color : colors[element][root];
+        }
+    }
+}
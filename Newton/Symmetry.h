@@ -0,0 +1,48 @@
+#ifndef root_symmetry
+#define root_symmetry
+#include <array>
+#include <vector>
+#include "Newton.cpp"
+#include "Certify.h"
+
+// Symmetry group of a root set: rotations about its centroid and, for a real
+// relaxation parameter, reflections in a horizontal or vertical axis. The
+// relaxed Newton map commutes with every such isometry T, so a point z ends in
+// the basin of T^-1(r) when T(z) ends in the basin of r. Of every orbit of
+// pixels under the isometries that map the pixel grid of the frame onto itself
+// only one pixel is iterated; the others are copied from it with the root
+// colour permuted. A view centred on a real symmetric root set halves the
+// work, square pixels around the centre also let quarter and half turns through.
+class Symmetry{
+    // z -> centre + turn * (z - centre), or its conjugate when reflect is set.
+    struct Isometry{
+        complex turn;
+        bool reflect;
+    };
+    complex centre;
+    int order;
+    bool mirrored;
+    double tolerance;
+    std::vector<std::pair<complex, char> > roots;
+    std::vector<Isometry> elements;
+    std::vector<std::vector<char> > colors;
+    std::array<int, 256> root_of_color;
+    TileCertifier certifier;
+    int find_root(complex p) const;
+    bool is_invariant(Isometry const &element) const;
+    bool is_aligned(const RenderDesc &desc, Isometry const &element) const;
+    complex apply(Isometry const &element, complex z) const;
+    complex inverse(Isometry const &element, complex z) const;
+    bool source(const RenderDesc &desc, int x, int y, int &element, int &cell) const;
+public:
+    Symmetry(const RenderDesc &desc);
+    // Size of the symmetry group of the root set.
+    int group_size() const;
+    // Iterates the pixels of the columns [x_begin, x_end) that are neither
+    // certified by TileCertifier nor copied from another pixel of the frame,
+    // and marks the copied ones PENDING.
+    void render_columns(const RenderDesc &desc, char *draw, int x_begin, int x_end) const;
+    // Fills the PENDING cells once all columns have been rendered.
+    void fill(const RenderDesc &desc, char *draw) const;
+};
+#endif
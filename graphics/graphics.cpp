@@ -6,6 +6,11 @@
 std::array<SDL_Color, 6> COLORS = {SDL_Color({44, 93, 55}), SDL_Color({227, 197, 21}), SDL_Color({238, 81, 177}), 
                                      SDL_Color({165, 156, 211}), SDL_Color({75, 45, 159}), SDL_Color({192, 168, 183}),
                                     };
+SDL_Color NON_CONVERGENT_COLOR = SDL_Color({0, 0, 0});
+
+SDL_Color basin_color(char color_key){
+    return color_key < 0 ? NON_CONVERGENT_COLOR : COLORS[color_key % COLORS.size()];
+}
 
 DPoint::DPoint(double x, double y):x(x), y(y){}
 DPoint::DPoint():x(0), y(0){}
@@ -37,6 +42,16 @@ VirtualFrame VirtualFrame::zoom(SDL_Point start, SDL_Point end, SDL_Rect &frame)
     double n_h = (n_w * frame.h) / frame.w;
     return VirtualFrame(n_x, n_y, n_w, n_h);
 }
+VirtualFrame VirtualFrame::zoom_at(SDL_Point p, double factor, SDL_Rect &frame){
+    DPoint v_p = to_virtual(p, frame);
+    double n_w = w * factor;
+    double n_h = h * factor;
+    return VirtualFrame(v_p.x - static_cast<double>(p.x) / frame.w * n_w,
+                        v_p.y + static_cast<double>(p.y) / frame.h * n_h, n_w, n_h);
+}
+VirtualFrame VirtualFrame::shift(double dx, double dy){
+    return VirtualFrame(x + dx, y + dy, w, h);
+}
 DPoint VirtualFrame::get_top_left(){
     return DPoint(x, y);
 }
@@ -232,10 +247,10 @@ void SelectBox::release(){
 }
 SDL_Rect const & SelectBox::get_rect(){return rect;}
 
-App::App(SDL_Rect frame, VirtualFrame virt_frame):frame(frame), virtual_frame(virt_frame), 
+App::App(SDL_Rect frame, VirtualFrame virt_frame, std::shared_ptr<RemoteClient> remote):frame(frame), virtual_frame(virt_frame), 
          newton(std::pair<double, double>(virt_frame.get_top_left().x, virt_frame.get_top_left().y), 
                  std::pair<double, double>(virt_frame.get_bottom_right().x, virt_frame.get_bottom_right().y)),
-         running(false), mode(NORMAL), select(SDL_Color({164, 197, 250, 200})) 
+         service(remote ? nullptr : new RenderService()), remote(remote), running(false), mode(NORMAL), select(SDL_Color({164, 197, 250, 200})), panning(false) 
     {
     if(SDL_Init(SDL_INIT_VIDEO) == 0){
         win.reset(new Window(frame));
@@ -272,6 +287,15 @@ void App::proccess_events(){
     while(SDL_PollEvent(&event)){
         if (event.type == SDL_QUIT){
             running = false;
+        }else if(event.type == SDL_MOUSEWHEEL){
+            SDL_Point mouse_pos;
+            SDL_GetMouseState(&mouse_pos.x, &mouse_pos.y);
+            wheel_zoom(mouse_pos, event.wheel.y);
+        }else if(event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_RIGHT){
+            panning = true;
+            pan_rest = DPoint(0, 0);
+        }else if(event.type == SDL_MOUSEBUTTONUP && event.button.button == SDL_BUTTON_RIGHT){
+            panning = false;
         }else if(event.type == SDL_MOUSEBUTTONDOWN){
             SDL_Point mouse_pos({event.button.x, event.button.y});
             bool button_pressed = false;
@@ -323,6 +347,9 @@ void App::proccess_events(){
             }
         }else if(event.type == SDL_MOUSEMOTION){
             SDL_Point mouse_pos({event.motion.x, event.motion.y});
+            if (panning){
+                pan(SDL_Point({event.motion.xrel, event.motion.yrel}));
+            }
             for (auto it = buttons.begin(); it != buttons.end(); ++it){
                 if (SDL_PointInRect(&mouse_pos, &((*it)->get_rect())))
                     (*it)->hover();
@@ -360,6 +387,7 @@ void App::loop(){
         moving_root->off();
         moving_root.reset();
     }
+    collect_frames();
 }
 void App::render(){
     SDL_RenderCopy(renderer->get(), background->get_texture(), NULL, NULL);
@@ -385,28 +413,23 @@ void App::add_mode(){
     mode = Mode::ADD;
 }
 void App::refresh(){
-    if (!draw_map.empty()){
-        draw_map.clear();
-    }
-    newton.method(draw_map);
+    pending.clear();
+    draw_map = *submit(newton.describe(), 0).get();
+    redraw();
+    mode = Mode::NORMAL;
+}
+void App::redraw(){
     for (int i = 0; i < draw_map_dims.first; ++i){
         for (int j = 0; j < draw_map_dims.second; ++j){
             int color_key = draw_map[ i * draw_map_dims.second + draw_map_dims.second - 1 - j];
-             background->draw_point(SDL_Point({i, j}), COLORS[color_key]);
+             background->draw_point(SDL_Point({i, j}), basin_color(color_key));
         }
     }
     background->update(*renderer);
-    mode = Mode::NORMAL;
 }
 void App::home(){
     mode = Mode::NORMAL;
-    VirtualFrame new_virt_frame(-1,1,2,2);
-    for (auto it = roots.begin(); it != roots.end(); ++it){
-        (*it)->move(new_virt_frame.to_SDL(virtual_frame.to_virtual((*it)->get_centre(), frame),frame));
-    }
-    virtual_frame = new_virt_frame;
-    newton.zoom(std::make_pair(-1,1), std::make_pair(1,-1));
-    refresh();
+    change_view(VirtualFrame(-1,1,2,2));
 }
 void App::move_mode(){
     mode = Mode::MOVE;
@@ -432,7 +455,14 @@ void App::create_root(SDL_Point p){
     }
 }
 void App::zoom(SDL_Point start, SDL_Point end){
-    VirtualFrame new_virt_frame = virtual_frame.zoom(start, end, frame);
+    change_view(virtual_frame.zoom(start, end, frame));
+}
+void App::wheel_zoom(SDL_Point p, int clicks){
+    if (clicks != 0){
+        change_view(virtual_frame.zoom_at(p, std::pow(0.8, clicks), frame));
+    }
+}
+void App::set_view(VirtualFrame new_virt_frame){
     for (auto it = roots.begin(); it != roots.end(); ++it){
         (*it)->move(new_virt_frame.to_SDL(virtual_frame.to_virtual((*it)->get_centre(), frame),frame));
     }
@@ -440,7 +470,108 @@ void App::zoom(SDL_Point start, SDL_Point end){
     DPoint v_top_left = virtual_frame.get_top_left();
     DPoint v_bottom_right = virtual_frame.get_bottom_right();
     newton.zoom(std::make_pair(v_top_left.x, v_top_left.y), std::make_pair(v_bottom_right.x, v_bottom_right.y));
-    refresh();
+}
+// Shows the previous frame resampled to the new view at once and renders the
+// new view in the background; collect_frames swaps it in when it is ready.
+void App::change_view(VirtualFrame new_virt_frame){
+    RenderDesc old_desc = newton.describe();
+    std::vector<char> old_map(draw_map);
+    set_view(new_virt_frame);
+    draw_map.assign(draw_map_dims.first * draw_map_dims.second, Newton::NO_ROOT);
+    if (!old_map.empty()){
+        blit(old_desc, old_map);
+    }
+    RenderDesc desc = newton.describe();
+    pending.clear();
+    pending.push_back(PendingFrame({desc, submit(desc, 0)}));
+    redraw();
+}
+// Moves the view by whole draw map pixels, so the pixels that stay on screen
+// are reused as they are and only the newly exposed strips are rendered.
+void App::pan(SDL_Point delta){
+    if (draw_map.empty()){
+        return;
+    }
+    pan_rest.x += static_cast<double>(delta.x) * draw_map_dims.first / frame.w;
+    pan_rest.y += static_cast<double>(delta.y) * draw_map_dims.second / frame.h;
+    int shift_x = static_cast<int>(pan_rest.x);
+    int shift_y = static_cast<int>(pan_rest.y);
+    pan_rest.x -= shift_x;
+    pan_rest.y -= shift_y;
+    int w = draw_map_dims.first, h = draw_map_dims.second;
+    shift_x = std::max(-w, std::min(w, shift_x));
+    shift_y = std::max(-h, std::min(h, shift_y));
+    if (shift_x == 0 && shift_y == 0){
+        return;
+    }
+    RenderDesc old_desc = newton.describe();
+    std::vector<char> old_map(draw_map);
+    set_view(virtual_frame.shift(-shift_x * virtual_frame.w / w, shift_y * virtual_frame.h / h));
+    draw_map.assign(w * h, Newton::NO_ROOT);
+    blit(old_desc, old_map);
+
+    RenderDesc desc = newton.describe();
+    std::vector<RenderDesc> strips;
+    int columns_x = shift_x > 0 ? 0 : w + shift_x;
+    if (shift_x != 0){
+        strips.push_back(desc.region(columns_x, 0, std::abs(shift_x), h));
+    }
+    if (shift_y != 0){
+        int rows_y = shift_y > 0 ? h - shift_y : 0;
+        int rest_x = shift_x > 0 ? shift_x : 0;
+        if (w - std::abs(shift_x) > 0){
+            strips.push_back(desc.region(rest_x, rows_y, w - std::abs(shift_x), std::abs(shift_y)));
+        }
+    }
+    for (auto it = strips.begin(); it != strips.end(); ++it){
+        pending.push_back(PendingFrame({*it, submit(*it)}));
+    }
+    redraw();
+}
+// Copies src, rendered for src_desc, into the pixels of draw_map that it covers.
+// Frames aligned with the current view are copied exactly, others are resampled.
+void App::blit(RenderDesc const &src_desc, std::vector<char> const &src){
+    RenderDesc desc = newton.describe();
+    double fraction_x = (desc.c4.first - desc.c1.first) / desc.width;
+    double fraction_y = (desc.c1.second - desc.c4.second) / desc.height;
+    double src_fraction_x = (src_desc.c4.first - src_desc.c1.first) / src_desc.width;
+    double src_fraction_y = (src_desc.c1.second - src_desc.c4.second) / src_desc.height;
+    for (int x = 0; x < desc.width; ++x){
+        int src_x = std::floor((desc.c1.first + fraction_x * (0.5 + x) - src_desc.c1.first) / src_fraction_x);
+        if (src_x < 0 || src_x >= src_desc.width){
+            continue;
+        }
+        for (int y = 0; y < desc.height; ++y){
+            int src_y = std::floor((desc.c4.second + fraction_y * (0.5 + y) - src_desc.c4.second) / src_fraction_y);
+            if (src_y >= 0 && src_y < src_desc.height){
+                draw_map[x * desc.height + y] = src[src_x * src_desc.height + src_y];
+            }
+        }
+    }
+}
+std::shared_future<Frame> App::submit(RenderDesc const &desc, int view){
+    if (remote){
+        return remote->submit(desc, view);
+    }
+    return service->submit(desc, RenderService::INTERACTIVE, view);
+}
+void App::collect_frames(){
+    bool changed = false;
+    RenderDesc desc = newton.describe();
+    for (auto it = pending.begin(); it != pending.end();){
+        if (it->frame.wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+            ++it;
+            continue;
+        }
+        if (it->desc.roots == desc.roots && it->desc.number_of_iterations == desc.number_of_iterations){
+            blit(it->desc, *it->frame.get());
+            changed = true;
+        }
+        it = pending.erase(it);
+    }
+    if (changed){
+        redraw();
+    }
 }
 App::~App(){
     SDL_Quit();
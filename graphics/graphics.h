@@ -5,6 +5,11 @@
 #include <array>
 #include <list>
 #include "../Newton/Newton.cpp"
+#include "../Newton/RenderService.h"
+#include "../Newton/Remote.h"
+
+extern std::array<SDL_Color, 6> COLORS;
+extern SDL_Color NON_CONVERGENT_COLOR;
 
 struct DPoint{
     double x;
@@ -31,6 +36,8 @@ struct VirtualFrame{
     DPoint to_virtual(SDL_Point p, SDL_Rect &frame);
     SDL_Point to_SDL(DPoint p, SDL_Rect &frame);
     VirtualFrame zoom(SDL_Point start, SDL_Point end, SDL_Rect &frame);
+    VirtualFrame zoom_at(SDL_Point p, double factor, SDL_Rect &frame);
+    VirtualFrame shift(double dx, double dy);
     DPoint get_top_left();
     DPoint get_bottom_right();
 };
@@ -162,6 +169,11 @@ public:
     SDL_Rect const & get_rect();
 };
 
+struct PendingFrame{
+    RenderDesc desc;
+    std::shared_future<Frame> frame;
+};
+
 class App{
 public:
     enum Mode {NORMAL, ADD, MOVE};
@@ -175,14 +187,21 @@ private:
     std::unique_ptr<SafeTexture> texture_atlas;
     std::unique_ptr<SafeTexture> background;
     Newton newton;
+    std::unique_ptr<RenderService> service;
+    std::shared_ptr<RemoteClient> remote;
     std::array<std::unique_ptr<Button>, 4> buttons; 
     std::list<std::shared_ptr<Root> > roots; 
     std::shared_ptr<Root> moving_root;
     SelectBox select;
     std::vector<char> draw_map;
     std::pair<int, int> draw_map_dims;
+    std::list<PendingFrame> pending;
+    bool panning;
+    DPoint pan_rest;
 public:
-    App(SDL_Rect frame, VirtualFrame virt_frame);
+    // With a remote client, frames are rendered by the server it is connected to
+    // and no local render threads are started.
+    App(SDL_Rect frame, VirtualFrame virt_frame, std::shared_ptr<RemoteClient> remote = nullptr);
     App(App const &src) = delete;
     App(App &&src) = delete;
     App& operator=(App const &src) = delete;
@@ -196,6 +215,14 @@ public:
     void refresh();
     void home();
     void zoom(SDL_Point start, SDL_Point end);
+    void wheel_zoom(SDL_Point p, int clicks);
+    void pan(SDL_Point delta);
+    void set_view(VirtualFrame new_virt_frame);
+    void change_view(VirtualFrame new_virt_frame);
+    void blit(RenderDesc const &src_desc, std::vector<char> const &src);
+    std::shared_future<Frame> submit(RenderDesc const &desc, int view = -1);
+    void collect_frames();
+    void redraw();
     void create_root(SDL_Point);
     void start_move_root(std::shared_ptr<Root> root);
     void end_move_root(SDL_Point p);
@@ -1,7 +1,60 @@
 #include "graphics/graphics.h"
-int main(){
-   App app(SDL_Rect({100,100, 1000, 800}), VirtualFrame(-1,0.8,2,1.6));
-   app.run();
+#include "Newton/BatchRunner.h"
+#include "Newton/Remote.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// main --batch jobs.txt renders the jobs listed in jobs.txt to BMP files
+// without opening a window; see BatchRunner for the job list format.
+// main --server PORT renders frames for clients started with
+// main --client HOST PORT, which only display them.
+int batch(char const *job_list){
+   std::ifstream in(job_list);
+   std::vector<BatchJob> jobs;
+   std::string error;
+   if (!in.is_open() || !BatchRunner::read_jobs(in, jobs, error)){
+      std::cerr << job_list << ": " << (error.empty() ? "cannot open" : error) << std::endl;
+      return 1;
+   }
+   std::vector<BatchRunner::Rgb> palette;
+   for (auto it = COLORS.begin(); it != COLORS.end(); ++it){
+      palette.push_back(BatchRunner::Rgb{{it->r, it->g, it->b}});
+   }
+   BatchRunner runner(palette, BatchRunner::Rgb{{NON_CONVERGENT_COLOR.r, NON_CONVERGENT_COLOR.g, NON_CONVERGENT_COLOR.b}});
+   BatchReport report = runner.run(jobs);
+   report.print(std::cout);
+   return report.failed == 0 ? 0 : 1;
+}
+
+int serve(char const *port){
+   RenderServer server(std::atoi(port));
+   if (!server){
+      std::cerr << "cannot listen on port " << port << std::endl;
+      return 1;
+   }
+   std::cout << "render server listening on port " << server.get_port() << std::endl;
+   server.serve();
    return 0;
 }
 
+int main(int argc, char *argv[]){
+   if (argc == 3 && std::string(argv[1]) == "--batch"){
+      return batch(argv[2]);
+   }
+   if (argc == 3 && std::string(argv[1]) == "--server"){
+      return serve(argv[2]);
+   }
+   std::shared_ptr<RemoteClient> remote;
+   if (argc == 4 && std::string(argv[1]) == "--client"){
+      remote.reset(new RemoteClient(argv[2], std::atoi(argv[3])));
+      if (!*remote){
+         std::cerr << remote->get_error() << std::endl;
+         return 1;
+      }
+   }
+   App app(SDL_Rect({100,100, 1000, 800}), VirtualFrame(-1,0.8,2,1.6), remote);
+   app.run();
+   return 0;
+}